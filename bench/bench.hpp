@@ -0,0 +1,192 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+/* Minimal benchmark harness.
+ *
+ * Each benchmark is warmed up, then timed over a number of repetitions. When
+ * a single call is too short to be timed reliably and there is nothing to
+ * reset between calls, each repetition runs the call several times. Results
+ * keep the minimum, median and mean of the repetitions, per call and per
+ * processed item.
+ */
+namespace bench
+{
+
+using Clock = std::chrono::steady_clock;
+
+// Repetitions shorter than this are batched
+const double MIN_REPETITION_NS = 1e6;
+
+
+struct Settings
+{
+    uint32_t    warmup = 3;
+    uint32_t    repetitions = 15;
+    std::string filter;
+};
+
+
+struct Result
+{
+    std::string name;
+    std::string size;
+    uint64_t    items;
+    uint32_t    repetitions;
+    uint32_t    batch;
+    // Per call
+    double      min_ns;
+    double      median_ns;
+    double      mean_ns;
+
+    double getMinPerItem() const
+    {
+        return min_ns / static_cast<double>(std::max<uint64_t>(1, items));
+    }
+
+    double getMedianPerItem() const
+    {
+        return median_ns / static_cast<double>(std::max<uint64_t>(1, items));
+    }
+};
+
+
+// Keeps the compiler from discarding a computed value
+template<typename T>
+inline void doNotOptimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+
+inline double getElapsedNs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+
+struct Runner
+{
+    Settings            settings;
+    std::vector<Result> results;
+    std::ostream*       log = nullptr;
+
+    bool isEnabled(const std::string& name) const
+    {
+        return settings.filter.empty() || name.find(settings.filter) != std::string::npos;
+    }
+
+    // setup is called before each call and not timed, run is timed
+    template<typename TSetup, typename TRun>
+    void run(const std::string& name, const std::string& size, uint64_t items, TSetup&& setup, TRun&& call)
+    {
+        if (!isEnabled(name)) {
+            return;
+        }
+        for (uint32_t i(0); i < settings.warmup; ++i) {
+            setup();
+            call();
+        }
+        std::vector<double> samples;
+        samples.reserve(settings.repetitions);
+        for (uint32_t i(0); i < settings.repetitions; ++i) {
+            setup();
+            const Clock::time_point start = Clock::now();
+            call();
+            samples.push_back(getElapsedNs(start));
+        }
+        addResult(name, size, items, 1, samples);
+    }
+
+    // Without setup, short calls are batched
+    template<typename TRun>
+    void run(const std::string& name, const std::string& size, uint64_t items, TRun&& call)
+    {
+        if (!isEnabled(name)) {
+            return;
+        }
+        double warmup_ns = 0.0;
+        for (uint32_t i(0); i < std::max(1u, settings.warmup); ++i) {
+            const Clock::time_point start = Clock::now();
+            call();
+            warmup_ns = getElapsedNs(start);
+        }
+        const uint32_t batch = static_cast<uint32_t>(std::max(1.0, MIN_REPETITION_NS / std::max(1.0, warmup_ns)));
+        std::vector<double> samples;
+        samples.reserve(settings.repetitions);
+        for (uint32_t i(0); i < settings.repetitions; ++i) {
+            const Clock::time_point start = Clock::now();
+            for (uint32_t k(batch); k--;) {
+                call();
+            }
+            samples.push_back(getElapsedNs(start) / batch);
+        }
+        addResult(name, size, items, batch, samples);
+    }
+
+    void printCSV(std::ostream& os) const
+    {
+        os << "name,size,items,repetitions,batch,min_ns,median_ns,mean_ns,min_ns_per_item,median_ns_per_item\n";
+        os << std::fixed << std::setprecision(3);
+        for (const Result& r : results) {
+            os << r.name << "," << r.size << "," << r.items << "," << r.repetitions << "," << r.batch << ","
+               << r.min_ns << "," << r.median_ns << "," << r.mean_ns << ","
+               << r.getMinPerItem() << "," << r.getMedianPerItem() << "\n";
+        }
+        os << std::flush;
+    }
+
+    void printJSON(std::ostream& os) const
+    {
+        os << "[\n" << std::fixed << std::setprecision(3);
+        for (uint64_t i(0); i < results.size(); ++i) {
+            const Result& r = results[i];
+            os << "  {\"name\": \"" << r.name << "\", \"size\": \"" << r.size << "\", \"items\": " << r.items
+               << ", \"repetitions\": " << r.repetitions << ", \"batch\": " << r.batch
+               << ", \"min_ns\": " << r.min_ns << ", \"median_ns\": " << r.median_ns << ", \"mean_ns\": " << r.mean_ns
+               << ", \"min_ns_per_item\": " << r.getMinPerItem()
+               << ", \"median_ns_per_item\": " << r.getMedianPerItem() << "}"
+               << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        os << "]\n" << std::flush;
+    }
+
+private:
+    void addResult(const std::string& name, const std::string& size, uint64_t items, uint32_t batch,
+                   std::vector<double>& samples)
+    {
+        Result result{name, size, items, static_cast<uint32_t>(samples.size()), batch, 0.0, 0.0, 0.0};
+        if (!samples.empty()) {
+            std::sort(samples.begin(), samples.end());
+            result.min_ns = samples.front();
+            result.median_ns = samples[samples.size() / 2];
+            for (const double s : samples) {
+                result.mean_ns += s;
+            }
+            result.mean_ns /= static_cast<double>(samples.size());
+        }
+        if (log) {
+            const std::ios::fmtflags flags = log->flags();
+            *log << std::left << std::setw(28) << name << std::setw(12) << size << std::right << std::fixed
+                 << std::setprecision(3) << std::setw(14) << result.median_ns * 1e-3 << " us"
+                 << std::setw(12) << result.getMedianPerItem() << " ns/item" << std::endl;
+            log->flags(flags);
+        }
+        results.push_back(result);
+    }
+};
+
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */
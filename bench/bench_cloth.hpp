@@ -0,0 +1,54 @@
+#pragma once
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+
+
+/* Cloth setup shared by the benchmark executables */
+namespace bench
+{
+
+struct ClothSize
+{
+    uint32_t width;
+    uint32_t height;
+
+    std::string toString() const
+    {
+        return std::to_string(width) + "x" + std::to_string(height);
+    }
+};
+
+
+// Comma separated WIDTHxHEIGHT list
+inline std::vector<ClothSize> parseSizes(const std::string& list)
+{
+    std::vector<ClothSize> sizes;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        const std::string::size_type x = item.find('x');
+        if (x == std::string::npos) {
+            throw std::logic_error("invalid cloth size " + item + ", expected WIDTHxHEIGHT");
+        }
+        sizes.push_back({to<uint32_t>(std::stoul(item.substr(0, x))), to<uint32_t>(std::stoul(item.substr(x + 1)))});
+    }
+    return sizes;
+}
+
+
+inline std::unique_ptr<PhysicSolver> makeSolver(const config& conf)
+{
+    auto solver = std::make_unique<PhysicSolver>(conf.gravity_x, conf.gravity_y, conf.friction_coef);
+    conf.buildCloth(*solver);
+    conf.setupSolver(*solver);
+    return solver;
+}
+
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -0,0 +1,186 @@
+/* Micro-benchmarks of the core containers and solver kernels */
+
+#include <memory>
+#include <optional>
+
+#include "bench.hpp"
+#include "bench_cloth.hpp"
+#include "cloth_mesh.hpp"
+
+const char* const SIZES_DEFAULT = "75x50,300x200,1000x1000";
+const uint32_t MULTIGRID_LEVELS = 8;
+const float SHEAR_STIFFNESS = 0.5f;
+const float BEND_STIFFNESS = 0.2f;
+
+using bench::ClothSize;
+using bench::makeSolver;
+using bench::parseSizes;
+
+static void benchContainers(bench::Runner& runner, const ClothSize& size)
+{
+    const std::string s = size.toString();
+    const uint64_t count = to<uint64_t>(size.width) * size.height;
+    std::optional<civ::CompactVector<Particle>> particles;
+    const auto fill = [&] {
+        particles.emplace();
+        for (uint64_t i(0); i < count; ++i) {
+            particles->emplace_back(Vec2(to<float>(i % size.width), to<float>(i / size.width)));
+        }
+    };
+
+    runner.run("vector/emplace_back", s, count,
+        [&] { particles.emplace(); },
+        [&] {
+            for (uint64_t i(0); i < count; ++i) {
+                particles->emplace_back(Vec2(to<float>(i), 0.0f));
+            }
+        });
+
+    runner.run("vector/erase", s, count / 2, fill, [&] {
+        for (uint64_t i(0); i < count; i += 2) {
+            particles->erase(to<civ::CompactID>(i));
+        }
+    });
+
+    fill();
+    runner.run("vector/iterate", s, count, [&] {
+        Vec2 sum;
+        for (const Particle& p : *particles) {
+            sum += p.position;
+        }
+        bench::doNotOptimize(sum);
+    });
+
+    std::vector<ParticleRef> refs;
+    refs.reserve(count);
+    for (uint64_t i(0); i < count; ++i) {
+        refs.push_back(particles->getRef(to<civ::CompactID>(i)));
+    }
+    runner.run("vector/ref_deref", s, count, [&] {
+        Vec2 sum;
+        for (ParticleRef& ref : refs) {
+            sum += ref->position;
+        }
+        bench::doNotOptimize(sum);
+    });
+}
+
+static void benchSolver(bench::Runner& runner, const config& conf, const ClothSize& size)
+{
+    const std::string s = size.toString();
+    std::unique_ptr<PhysicSolver> solver = makeSolver(conf);
+    const uint64_t particles = solver->objects.size();
+    const uint64_t links = solver->constraints.size();
+    const float dt = 1.0f / 60.0f;
+    const float sub_step_dt = dt / to<float>(solver->sub_steps);
+
+    runner.run("link/solve", s, links, [&] {
+        float length = 0.0f;
+        for (LinkConstraint& link : solver->constraints) {
+            length += link.solve();
+        }
+        bench::doNotOptimize(length);
+    });
+    runner.run("solver/integrate", s, particles, [&] { solver->integrate(sub_step_dt); });
+    runner.run("solver/constraints", s, links, [&] { solver->solveConstraints(sub_step_dt); });
+    runner.run("solver/derivatives", s, particles, [&] { solver->updateDerivatives(sub_step_dt); });
+    runner.run("solver/update", s, particles * solver->sub_steps, [&] { solver->update(dt); });
+
+    const ConstraintSolver constraint_solver = solver->kernel_config.constraint_solver;
+    solver->kernel_config.constraint_solver = ConstraintSolver::XPBD;
+    solver->updateKernel();
+    runner.run("solver/xpbd_constraints", s, links, [&] { solver->solveConstraints(sub_step_dt); });
+    solver->kernel_config.constraint_solver = constraint_solver;
+    solver->updateKernel();
+
+    // Same pass over the links of every kind, on a cloth of its own
+    config bending_conf = conf;
+    bending_conf.shear_stiffness = SHEAR_STIFFNESS;
+    bending_conf.bend_stiffness = BEND_STIFFNESS;
+    std::unique_ptr<PhysicSolver> bending = makeSolver(bending_conf);
+    const uint64_t all_links = links + bending->shear_links.links.size() + bending->bend_links.links.size();
+    runner.run("solver/bending_constraints", s, all_links, [&] { bending->solveConstraints(sub_step_dt); });
+    bending.reset();
+
+    // The first, untimed, calls find the attachments and build the levels
+    solver->long_range.enabled = true;
+    runner.run("solver/long_range", s, particles, [&] { solver->long_range.solve(*solver); });
+    solver->long_range.enabled = false;
+    solver->multigrid.levels = MULTIGRID_LEVELS;
+    runner.run("solver/multigrid", s, links, [&] { solver->multigrid.solve(*solver); });
+    solver->multigrid.levels = 0;
+
+    WindManager wind(to<float>(conf.window_width));
+    conf.buildWind(wind);
+    runner.run("wind/update", s, particles, [&] { wind.update(*solver, dt); });
+
+    Renderer renderer(*solver);
+    runner.run("renderer/update_va", s, links, [&] { renderer.updateVA(); });
+
+    ClothMesh mesh(*solver);
+    mesh.updateIndices(*solver);
+    runner.run("mesh/update_positions", s, particles, [&] { mesh.updatePositions(*solver); });
+
+    runner.run("config/build_cloth", s, particles,
+        [&] { solver = std::make_unique<PhysicSolver>(conf.gravity_x, conf.gravity_y, conf.friction_coef); },
+        [&] { conf.buildCloth(*solver); });
+}
+
+int main(int argc, char* argv[])
+{
+    po::options_description opts("benchmark options");
+    opts.add_options()
+        ("help,h", "produce help message")
+        ("sizes", po::value<std::string>()->default_value(SIZES_DEFAULT),
+        "comma separated cloth sizes, WIDTHxHEIGHT")
+        ("warmup", po::value<uint32_t>()->default_value(3), "untimed calls before measuring")
+        ("reps", po::value<uint32_t>()->default_value(15), "timed repetitions")
+        ("filter", po::value<std::string>()->default_value(""), "only run benchmarks whose name contains this")
+        ("format", po::value<std::string>()->default_value("csv"), "output format, csv or json")
+        ("quiet,q", "do not log results to stderr while running")
+        ;
+    bench::Runner runner;
+    std::vector<ClothSize> sizes;
+    std::string format;
+    try {
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, opts), vm);
+        vm.notify();
+        if (vm.count("help")) {
+            std::cerr << "usage: " << argv[0] << " [options...]" << std::endl;
+            opts.print(std::cerr);
+            return 0;
+        }
+        sizes = parseSizes(vm["sizes"].as<std::string>());
+        runner.settings.warmup = vm["warmup"].as<uint32_t>();
+        runner.settings.repetitions = vm["reps"].as<uint32_t>();
+        runner.settings.filter = vm["filter"].as<std::string>();
+        format = vm["format"].as<std::string>();
+        if (format != "csv" && format != "json") {
+            throw std::logic_error("unknown format " + format);
+        }
+        if (!vm.count("quiet")) {
+            runner.log = &std::cerr;
+        }
+    } catch (const std::exception& err) {
+        std::cerr << "failed to parse command-line: " << err.what() << std::endl;
+        return 1;
+    }
+
+    for (const ClothSize& size : sizes) {
+        config conf;
+        conf.cloth_width = size.width;
+        conf.cloth_height = size.height;
+        benchContainers(runner, size);
+        benchSolver(runner, conf, size);
+    }
+
+    if (format == "json") {
+        runner.printJSON(std::cout);
+    } else {
+        runner.printCSV(std::cout);
+    }
+    return 0;
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -0,0 +1,289 @@
+/* Performance regression gate.
+ *
+ * Runs the scenarios listed in a baseline file, times each solver phase and
+ * compares the results to the recorded ones. Timings are divided by the time
+ * of a fixed calibration loop, so that a baseline recorded on one machine
+ * holds on similar ones. A phase slower than its baseline by more than the
+ * tolerance fails the run, with a table of every phase. --update records the
+ * current results as the new baseline.
+ *
+ * Baseline format, config paths are relative to the baseline file:
+ * {
+ *   "tolerance": 0.35,
+ *   "scenarios": [
+ *     {"name": "default", "config": "default.json", "warmup_frames": 120,
+ *      "tolerances": {"frame": 0.5}, "phases": {"integrate": 1.25, ...}}
+ *   ]
+ * }
+ */
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+#include "bench.hpp"
+#include "bench_cloth.hpp"
+
+const float TOLERANCE_DEFAULT = 0.3f;
+const uint32_t CALIBRATION_SIZE = 1 << 16;
+
+
+struct PhaseCheck
+{
+    std::string phase;
+    double      baseline;
+    double      current;
+    float       tolerance;
+
+    double getChange() const
+    {
+        return baseline > 0.0 ? current / baseline - 1.0 : 0.0;
+    }
+
+    bool isRegression() const
+    {
+        return baseline > 0.0 && getChange() > tolerance;
+    }
+};
+
+
+/* Fixed mix of dependent arithmetic and strided loads over an L2 sized array,
+ * roughly the kind of work the solver does. Returns the best time per element
+ * in nanoseconds. */
+static double calibrate(const bench::Settings& settings)
+{
+    std::vector<float> values(CALIBRATION_SIZE);
+    for (uint32_t i(0); i < CALIBRATION_SIZE; ++i) {
+        values[i] = 1.0f + to<float>(i % 97) * 0.01f;
+    }
+    bench::Runner runner;
+    runner.settings = settings;
+    runner.run("calibration", "", CALIBRATION_SIZE, [&] {
+        const uint32_t mask = CALIBRATION_SIZE - 1;
+        float acc = 0.0f;
+        for (uint32_t i(0); i < CALIBRATION_SIZE; ++i) {
+            const float v = values[(i * 7) & mask];
+            acc += std::sqrt(v * v + acc * 1e-6f);
+            values[i] = v * 0.999f + 0.001f;
+        }
+        bench::doNotOptimize(acc);
+    });
+    return runner.results.front().getMinPerItem();
+}
+
+
+/* Brings the scenario to a representative state, then times each phase in
+ * calibration units per processed element. Every timed call starts from that
+ * same state, particles, links and wind, repeated calls of a single phase
+ * would otherwise drift away from anything the simulation produces and keep
+ * tearing the cloth apart. The best repetition is kept, it is the least
+ * sensitive to other processes. */
+static std::map<std::string, double> runScenario(const config& conf, uint32_t warmup_frames,
+                                                 const bench::Settings& settings, double calibration_ns)
+{
+    std::unique_ptr<PhysicSolver> solver = bench::makeSolver(conf);
+    WindManager wind(to<float>(conf.window_width));
+    conf.buildWind(wind);
+    const float dt = 1.0f / 60.0f;
+    for (uint32_t i(0); i < warmup_frames; ++i) {
+        wind.update(*solver, dt);
+        solver->update(dt);
+    }
+
+    const std::vector<Particle> particles_state(solver->objects.data.begin(), solver->objects.data.end());
+    // Whole containers, the IDs and metadata bring the erased links back
+    const civ::CompactSplitVector<LinkConstraint, LinkInfo> links_state = solver->constraints;
+    const LinkGroup shear_links_state = solver->shear_links;
+    const LinkGroup bend_links_state = solver->bend_links;
+    const WindManager wind_state = wind;
+    uint64_t topology_version = solver->topology_version;
+    const auto restore = [&] {
+        std::copy(particles_state.begin(), particles_state.end(), solver->objects.data.begin());
+        solver->constraints = links_state;
+        solver->shear_links = shear_links_state;
+        solver->bend_links = bend_links_state;
+        solver->broken_links.clear();
+        // What was built from the links must see them come back
+        if (solver->topology_version != topology_version) {
+            topology_version = ++solver->topology_version;
+        }
+        wind = wind_state;
+    };
+    const uint64_t particles = solver->objects.size();
+    const uint64_t links = solver->constraints.size();
+    const float sub_step_dt = dt / to<float>(solver->sub_steps);
+    bench::Runner runner;
+    runner.settings = settings;
+    runner.run("integrate", "", particles, restore, [&] { solver->integrate(sub_step_dt); });
+    runner.run("constraints", "", links, restore, [&] { solver->solveConstraints(sub_step_dt); });
+    runner.run("derivatives", "", particles, restore, [&] { solver->updateDerivatives(sub_step_dt); });
+    runner.run("wind", "", particles, restore, [&] { wind.update(*solver, dt); });
+    // Whole frames, per particle sub-step, the inverse of the throughput
+    runner.run("frame", "", particles * solver->sub_steps, restore, [&] { solver->update(dt); });
+
+    std::map<std::string, double> costs;
+    for (const bench::Result& result : runner.results) {
+        costs[result.name] = result.getMinPerItem() / calibration_ns;
+    }
+    return costs;
+}
+
+
+static void printChecks(std::ostream& os, const std::string& scenario, const std::vector<PhaseCheck>& checks,
+                        double calibration_ns)
+{
+    const std::ios::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+    os << "scenario " << scenario << " (calibration units per element):\n"
+       << std::left << std::setw(16) << "phase" << std::right << std::setw(12) << "baseline"
+       << std::setw(12) << "current" << std::setw(10) << "change" << std::setw(10) << "band" << "  status\n";
+    for (const PhaseCheck& c : checks) {
+        os << std::left << std::setw(16) << c.phase << std::right << std::fixed << std::setprecision(3)
+           << std::setw(12) << c.baseline << std::setw(12) << c.current << std::setprecision(1)
+           << std::setw(9) << std::showpos << c.getChange() * 100.0 << "%" << std::noshowpos
+           << std::setw(8) << "+-" << std::setprecision(0) << c.tolerance * 100.0 << "%  ";
+        if (c.baseline <= 0.0) {
+            os << "new";
+        } else if (c.isRegression()) {
+            os << "REGRESSED";
+        } else if (c.getChange() < -c.tolerance) {
+            os << "faster, consider updating the baseline";
+        } else {
+            os << "ok";
+        }
+        os << "\n";
+        if (c.phase == "frame") {
+            os << std::setprecision(3) << "  throughput " << 1e3 / (c.current * calibration_ns)
+               << " M particle sub-steps/s on this machine\n";
+        }
+    }
+    os.flags(flags);
+    os.precision(precision);
+    os << std::flush;
+}
+
+
+int main(int argc, char* argv[])
+{
+    po::options_description opts("performance gate options");
+    opts.add_options()
+        ("help,h", "produce help message")
+        ("baseline", po::value<std::string>()->required(), "baseline file listing the scenarios")
+        ("update", "record the current results as the new baseline instead of comparing")
+        ("tolerance", po::value<float>(), "override the tolerance of every phase, 0.3 for 30%")
+        ("reps", po::value<uint32_t>()->default_value(15), "timed repetitions per phase")
+        ("retries", po::value<uint32_t>()->default_value(2), "times a scenario is measured again when a phase regresses")
+        ;
+    std::string baseline_path;
+    bool update = false;
+    float tolerance_override = -1.0f;
+    uint32_t rounds = 0;
+    bench::Settings settings;
+    try {
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, opts), vm);
+        if (vm.count("help")) {
+            std::cerr << "usage: " << argv[0] << " --baseline PATH [options...]" << std::endl;
+            opts.print(std::cerr);
+            return 0;
+        }
+        vm.notify();
+        baseline_path = vm["baseline"].as<std::string>();
+        update = vm.count("update") > 0;
+        if (vm.count("tolerance")) {
+            tolerance_override = vm["tolerance"].as<float>();
+        }
+        settings.repetitions = vm["reps"].as<uint32_t>();
+        rounds = vm["retries"].as<uint32_t>();
+    } catch (const std::exception& err) {
+        std::cerr << "failed to parse command-line: " << err.what() << std::endl;
+        return 1;
+    }
+
+    json baseline;
+    try {
+        std::ifstream ifs(baseline_path);
+        if (!ifs) {
+            std::cerr << "Failed reading " << baseline_path << ": " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        baseline = json::parse(ifs);
+    } catch (const json::exception& err) {
+        std::cerr << "Failed to parse " << baseline_path << ": " << err.what() << std::endl;
+        return 1;
+    }
+    const std::string::size_type slash = baseline_path.find_last_of("/\\");
+    const std::string directory = slash == std::string::npos ? "" : baseline_path.substr(0, slash + 1);
+    const float tolerance_default = baseline.value("tolerance", TOLERANCE_DEFAULT);
+
+    const double calibration_ns = calibrate(settings);
+    std::cout << "calibration: " << calibration_ns << " ns per element" << std::endl;
+
+    uint32_t regressions = 0;
+    for (json& scenario : baseline["scenarios"]) {
+        const std::string name = scenario.value("name", "unnamed");
+        config conf;
+        // The default wind is part of the scenarios unless they define their own
+        if (scenario.contains("config")
+            && conf.parseConfigurationFile(directory + scenario["config"].get<std::string>()) != config::Status::OK) {
+            return 1;
+        }
+        const json phases = scenario.value("phases", json::object());
+        const json tolerances = scenario.value("tolerances", json::object());
+        const auto getTolerance = [&](const std::string& phase) {
+            return tolerance_override >= 0.0f ? tolerance_override : tolerances.value(phase, tolerance_default);
+        };
+        // A slow phase is measured again before being reported, keeping the
+        // best result of each phase, so that a noisy moment does not fail the run
+        std::map<std::string, double> costs;
+        for (uint32_t round(0); round <= (update ? 0 : rounds); ++round) {
+            bool regressed = false;
+            for (const auto& [phase, cost] : runScenario(conf, scenario.value("warmup_frames", 0u),
+                                                         settings, calibration_ns)) {
+                const auto it = costs.find(phase);
+                const double best = it == costs.end() ? cost : std::min(it->second, cost);
+                costs[phase] = best;
+                regressed |= PhaseCheck{phase, phases.value(phase, 0.0), best, getTolerance(phase)}.isRegression();
+            }
+            if (!regressed) {
+                break;
+            }
+        }
+        if (update) {
+            scenario["phases"] = json::object();
+            for (const auto& [phase, cost] : costs) {
+                // Three significant digits are well within the noise
+                const double scale = std::pow(10.0, 2.0 - std::floor(std::log10(cost)));
+                scenario["phases"][phase] = std::round(cost * scale) / scale;
+            }
+        }
+
+        std::vector<PhaseCheck> checks;
+        for (const auto& [phase, cost] : costs) {
+            checks.push_back({phase, update ? scenario["phases"].value(phase, 0.0) : phases.value(phase, 0.0), cost,
+                              getTolerance(phase)});
+            regressions += checks.back().isRegression();
+        }
+        printChecks(std::cout, name, checks, calibration_ns);
+    }
+
+    if (update) {
+        std::ofstream ofs(baseline_path);
+        ofs << baseline.dump(2) << "\n";
+        if (!ofs) {
+            std::cerr << "Failed writing " << baseline_path << std::endl;
+            return 1;
+        }
+        std::cout << "baseline written to " << baseline_path << std::endl;
+        return 0;
+    }
+    if (regressions) {
+        std::cout << regressions << " phase(s) regressed beyond their tolerance" << std::endl;
+        return 1;
+    }
+    std::cout << "no regression" << std::endl;
+    return 0;
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */
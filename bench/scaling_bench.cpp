@@ -0,0 +1,292 @@
+/* Strong and weak scaling of the headless simulation over cloth sizes and
+ * thread counts.
+ *
+ * Strong scaling keeps the cloth size and adds threads, weak scaling grows the
+ * cloth height with the thread count so that each thread keeps the same share
+ * of particles. Parallel efficiency is the throughput relative to the smallest
+ * thread count of the same configuration, divided by the added threads.
+ * --solvers compares constraint solvers on the same runs, for instance
+ * --solvers pbd,pd --sizes 1000x1000 for the projective dynamics solver.
+ */
+
+#include <fstream>
+#include <limits>
+#include <thread>
+#ifdef __linux__
+    #include <sys/resource.h>
+#endif
+
+#include "bench.hpp"
+#include "bench_cloth.hpp"
+
+const char* const SIZES_DEFAULT = "75x50,250x200,1000x1000,4000x4000";
+const uint32_t FRAMES_DEFAULT = 20;
+const uint32_t WARMUP_FRAMES = 2;
+
+using bench::ClothSize;
+
+
+struct ScalingRun
+{
+    std::string mode;
+    std::string solver;
+    ClothSize   size;
+    uint64_t    particles;
+    uint64_t    links;
+    uint32_t    threads;
+    bool        tearing;
+    bool        wind;
+    uint32_t    frames;
+    double      seconds;
+    double      substeps_per_s;
+    double      efficiency;
+    double      memory_hwm_mb;
+    uint64_t    links_remaining;
+};
+
+
+// Resets the resident set high-water mark, returns false if not supported
+static bool resetMemoryHighWaterMark()
+{
+#ifdef __linux__
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    return static_cast<bool>(clear_refs.flush());
+#else
+    return false;
+#endif
+}
+
+
+// Peak resident set size in MB, since the last reset when supported
+static double getMemoryHighWaterMark()
+{
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::stod(line.substr(6)) / 1024.0;
+        }
+    }
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return static_cast<double>(usage.ru_maxrss) / 1024.0;
+    }
+#endif
+    return 0.0;
+}
+
+
+// "both", "on" or "off"
+static std::vector<bool> parseToggle(const std::string& name, const std::string& value)
+{
+    if (value == "both") {
+        return {false, true};
+    }
+    if (value == "on" || value == "off") {
+        return {value == "on"};
+    }
+    throw std::logic_error("invalid --" + name + " value " + value + ", expected both, on or off");
+}
+
+
+static std::vector<uint32_t> parseThreads(const std::string& list)
+{
+    std::vector<uint32_t> threads;
+    if (list.empty()) {
+        // Powers of two up to the number of cores, and the number of cores itself
+        const uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+        for (uint32_t n(1); n < cores; n *= 2) {
+            threads.push_back(n);
+        }
+        threads.push_back(cores);
+        return threads;
+    }
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        const uint32_t n = to<uint32_t>(std::stoul(item));
+        if (n == 0) {
+            throw std::logic_error("thread counts must be positive");
+        }
+        threads.push_back(n);
+    }
+    std::sort(threads.begin(), threads.end());
+    return threads;
+}
+
+
+static std::vector<ConstraintSolver> parseSolvers(const std::string& list)
+{
+    std::vector<ConstraintSolver> solvers;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        ConstraintSolver solver;
+        if (!parseConstraintSolver(item, solver)) {
+            throw std::logic_error("unknown or unavailable solver " + item);
+        }
+        solvers.push_back(solver);
+    }
+    return solvers;
+}
+
+
+static ScalingRun runScaling(const config& conf, uint32_t threads, bool tearing, bool wind_enabled, uint32_t frames)
+{
+    const bool hwm_reset = resetMemoryHighWaterMark();
+    tp::ThreadPool thread_pool(threads);
+    std::unique_ptr<PhysicSolver> solver = bench::makeSolver(conf);
+    solver->setThreadPool(&thread_pool);
+    if (!tearing) {
+        for (LinkInfo& info : solver->constraints.cold) {
+            info.max_elongation_ratio = std::numeric_limits<float>::infinity();
+        }
+    }
+    WindManager wind(to<float>(conf.window_width));
+    if (wind_enabled) {
+        conf.buildWind(wind);
+    }
+
+    ScalingRun run;
+    run.solver = getConstraintSolverName(conf.constraint_solver);
+    run.size = {conf.cloth_width, conf.cloth_height};
+    run.particles = solver->objects.size();
+    run.links = solver->constraints.size();
+    run.threads = threads;
+    run.tearing = tearing;
+    run.wind = wind_enabled;
+    run.frames = frames;
+
+    const float dt = 1.0f / 60.0f;
+    const auto step = [&] {
+        wind.update(*solver, dt);
+        solver->update(dt);
+    };
+    for (uint32_t i(0); i < WARMUP_FRAMES; ++i) {
+        step();
+    }
+    const bench::Clock::time_point start = bench::Clock::now();
+    for (uint32_t i(0); i < frames; ++i) {
+        step();
+    }
+    run.seconds = bench::getElapsedNs(start) * 1e-9;
+    run.substeps_per_s = static_cast<double>(run.particles) * solver->sub_steps * frames / std::max(1e-9, run.seconds);
+    run.efficiency = 0.0;
+    // Without a reset the peak covers the whole process so far. Memory freed
+    // by earlier runs but kept by the allocator still counts as resident
+    run.memory_hwm_mb = hwm_reset ? getMemoryHighWaterMark() : -1.0;
+    run.links_remaining = solver->constraints.size();
+    return run;
+}
+
+
+static void printCSV(std::ostream& os, const std::vector<ScalingRun>& runs)
+{
+    os << "mode,solver,width,height,particles,links,threads,tearing,wind,frames,seconds,"
+          "particle_substeps_per_s,parallel_efficiency,memory_hwm_mb,links_remaining\n";
+    os << std::fixed;
+    for (const ScalingRun& r : runs) {
+        os << r.mode << "," << r.solver << "," << r.size.width << "," << r.size.height << "," << r.particles << "," << r.links << ","
+           << r.threads << "," << (r.tearing ? "on" : "off") << "," << (r.wind ? "on" : "off") << ","
+           << r.frames << "," << std::setprecision(6) << r.seconds << "," << std::setprecision(0) << r.substeps_per_s
+           << "," << std::setprecision(3) << r.efficiency << "," << std::setprecision(1) << r.memory_hwm_mb << ","
+           << r.links_remaining << "\n";
+    }
+    os << std::flush;
+}
+
+
+int main(int argc, char* argv[])
+{
+    po::options_description opts("scaling options");
+    opts.add_options()
+        ("help,h", "produce help message")
+        ("sizes", po::value<std::string>()->default_value(SIZES_DEFAULT),
+        "comma separated cloth sizes, WIDTHxHEIGHT, with one thread in weak mode")
+        ("threads", po::value<std::string>()->default_value(""),
+        "comma separated thread counts, powers of two up to the number of cores by default")
+        ("frames", po::value<uint32_t>()->default_value(FRAMES_DEFAULT), "timed frames per run")
+        ("mode", po::value<std::string>()->default_value("strong"), "strong, weak or both")
+        ("tearing", po::value<std::string>()->default_value("both"), "links tearing: both, on or off")
+        ("wind", po::value<std::string>()->default_value("both"), "wind: both, on or off")
+        ("solvers", po::value<std::string>()->default_value("pbd"), "comma separated constraint solvers")
+        ("quiet,q", "do not log runs to stderr")
+        ;
+    std::vector<ClothSize> sizes;
+    std::vector<uint32_t> threads;
+    std::vector<std::string> modes;
+    std::vector<bool> tearings;
+    std::vector<bool> winds;
+    std::vector<ConstraintSolver> solvers;
+    uint32_t frames = FRAMES_DEFAULT;
+    bool quiet = false;
+    try {
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, opts), vm);
+        vm.notify();
+        if (vm.count("help")) {
+            std::cerr << "usage: " << argv[0] << " [options...]" << std::endl;
+            opts.print(std::cerr);
+            return 0;
+        }
+        sizes = bench::parseSizes(vm["sizes"].as<std::string>());
+        threads = parseThreads(vm["threads"].as<std::string>());
+        frames = vm["frames"].as<uint32_t>();
+        const std::string mode = vm["mode"].as<std::string>();
+        if (mode == "both") {
+            modes = {"strong", "weak"};
+        } else if (mode == "strong" || mode == "weak") {
+            modes = {mode};
+        } else {
+            throw std::logic_error("unknown mode " + mode);
+        }
+        tearings = parseToggle("tearing", vm["tearing"].as<std::string>());
+        winds = parseToggle("wind", vm["wind"].as<std::string>());
+        solvers = parseSolvers(vm["solvers"].as<std::string>());
+        quiet = vm.count("quiet") > 0;
+    } catch (const std::exception& err) {
+        std::cerr << "failed to parse command-line: " << err.what() << std::endl;
+        return 1;
+    }
+
+    std::vector<ScalingRun> runs;
+    for (const std::string& mode : modes) {
+        for (const ClothSize& size : sizes) {
+            for (const ConstraintSolver solver : solvers) {
+                for (const bool tearing : tearings) {
+                    for (const bool wind : winds) {
+                        // Index of the run with the smallest thread count
+                        const uint64_t reference = runs.size();
+                        for (const uint32_t n : threads) {
+                            config conf;
+                            conf.cloth_width = size.width;
+                            conf.cloth_height = mode == "weak" ? size.height * n : size.height;
+                            conf.constraint_solver = solver;
+                            ScalingRun run = runScaling(conf, n, tearing, wind, frames);
+                            run.mode = mode;
+                            runs.push_back(run);
+                            ScalingRun& r = runs.back();
+                            const ScalingRun& ref = runs[reference];
+                            r.efficiency = (r.substeps_per_s / r.threads) / (ref.substeps_per_s / ref.threads);
+                            if (!quiet) {
+                                std::cerr << mode << " " << r.solver << " " << r.size.toString() << " threads " << n
+                                          << " tearing " << (tearing ? "on" : "off")
+                                          << " wind " << (wind ? "on" : "off") << ": " << std::fixed
+                                          << std::setprecision(3) << r.substeps_per_s * 1e-6
+                                          << " M particle sub-steps/s, efficiency " << r.efficiency
+                                          << std::defaultfloat << std::endl;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    printCSV(std::cout, runs);
+    return 0;
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -0,0 +1,214 @@
+#pragma once
+#include <thread>
+#include "engine/common/thread_pool.hpp"
+#include "engine/physics/physics.hpp"
+
+/* Builds a rectangular cloth pinned by its top row.
+ *
+ * Particles are laid out row-major and each particle links to its left and top
+ * neighbors, so every particle and link ID can be computed from the grid
+ * coordinates. This allows allocating everything at once and filling the
+ * solver arrays in parallel, one batch of rows per thread.
+ *
+ * With a stiffness above 0, each cell also gets both diagonals as shear links
+ * and each particle is linked to the particles two columns and two rows away
+ * as bend links, laid out row by row the same way.
+ */
+struct ClothBuilder
+{
+    uint32_t width;
+    uint32_t height;
+    float links_length;
+    Vec2 origin;
+    // 0 for none
+    float shear_stiffness = 0.0f;
+    float bend_stiffness = 0.0f;
+
+    ClothBuilder(uint32_t w, uint32_t h, float length, Vec2 o)
+        : width(w)
+        , height(h)
+        , links_length(length)
+        , origin(o)
+    {}
+
+    uint64_t getParticlesCount() const
+    {
+        return to<uint64_t>(width) * height;
+    }
+
+    uint64_t getLinksCount() const
+    {
+        if (!width || !height) { return 0; }
+        return to<uint64_t>(width - 1) * height + to<uint64_t>(width) * (height - 1);
+    }
+
+    // Offset of the first link of row y; row 0 only has horizontal links
+    uint64_t getRowFirstLink(uint32_t y) const
+    {
+        if (y == 0) { return 0; }
+        return (width - 1) + to<uint64_t>(y - 1) * (2 * width - 1);
+    }
+
+    uint64_t getShearLinksCount() const
+    {
+        if (width < 2 || height < 2 || shear_stiffness <= 0.0f) { return 0; }
+        return 2 * to<uint64_t>(width - 1) * (height - 1);
+    }
+
+    // Rows from 1 have two diagonals per cell above them
+    uint64_t getRowFirstShearLink(uint32_t y) const
+    {
+        return 2 * to<uint64_t>(width - 1) * (y - 1);
+    }
+
+    uint64_t getBendLinksCount() const
+    {
+        if (!width || !height || bend_stiffness <= 0.0f) { return 0; }
+        return getRowFirstBendLink(height);
+    }
+
+    // Each row has width - 2 horizontal links, rows from 2 also width vertical ones
+    uint64_t getRowFirstBendLink(uint32_t y) const
+    {
+        const uint64_t horizontal = width > 2 ? width - 2 : 0;
+        return horizontal * y + (y > 2 ? to<uint64_t>(width) * (y - 2) : 0);
+    }
+
+    uint64_t getAllLinksCount() const
+    {
+        return getLinksCount() + getShearLinksCount() + getBendLinksCount();
+    }
+
+    float getMaxElongation(uint32_t y) const
+    {
+        return 1.2f * (2.0f - y / float(height));
+    }
+
+    // Uses a temporary pool, prefer the overload below when one is available
+    void build(PhysicSolver& solver) const
+    {
+        tp::ThreadPool pool(std::thread::hardware_concurrency());
+        build(solver, pool);
+    }
+
+    void build(PhysicSolver& solver, tp::ThreadPool& pool) const
+    {
+        const uint64_t particles_count = getParticlesCount();
+        if (!particles_count) { return; }
+        const uint64_t links_count = getLinksCount();
+        const uint64_t shear_links_count = getShearLinksCount();
+        const uint64_t bend_links_count = getBendLinksCount();
+        solver.reserve(solver.objects.size() + particles_count,
+                       solver.constraints.size() + links_count);
+        solver.shear_links.links.reserve(solver.shear_links.links.size() + shear_links_count);
+        solver.bend_links.links.reserve(solver.bend_links.links.size() + bend_links_count);
+
+        const civ::CompactID first_particle = solver.addParticles(particles_count);
+        const uint64_t first_particle_index = solver.objects.getDataID(first_particle);
+        pool.dispatch(height, [&](uint64_t start, uint64_t end) {
+            for (uint32_t y = to<uint32_t>(start); y < end; ++y) {
+                for (uint32_t x = 0; x < width; ++x) {
+                    const uint64_t i = to<uint64_t>(y) * width + x;
+                    Particle& p = solver.objects.data[first_particle_index + i];
+                    p = Particle(origin + Vec2(x * links_length, y * links_length));
+                    p.id = to<civ::CompactID>(first_particle + i);
+                }
+            }
+        });
+        for (uint32_t x = 0; x < width; ++x) {
+            solver.pin(to<civ::CompactID>(first_particle + x));
+        }
+
+        // Links need the particles positions to compute their rest length
+        const civ::CompactID first_link = solver.addLinks(links_count);
+        const uint64_t first_link_index = solver.constraints.getDataID(first_link);
+        pool.dispatch(height, [&](uint64_t start, uint64_t end) {
+            for (uint32_t y = to<uint32_t>(start); y < end; ++y) {
+                const float max_elongation = getMaxElongation(y);
+                uint64_t link = getRowFirstLink(y);
+                for (uint32_t x = 0; x < width; ++x) {
+                    const civ::CompactID id = to<civ::CompactID>(first_particle + to<uint64_t>(y) * width + x);
+                    if (x > 0) {
+                        setLink(solver, first_link_index + link, to<civ::CompactID>(first_link + link), id - 1, id, max_elongation * 0.9f);
+                        ++link;
+                    }
+                    if (y > 0) {
+                        setLink(solver, first_link_index + link, to<civ::CompactID>(first_link + link), id - width, id, max_elongation);
+                        ++link;
+                    }
+                }
+            }
+        });
+
+        if (shear_links_count) {
+            LinkGroup& group = solver.shear_links;
+            const civ::CompactID first_shear = solver.addLinks(group, shear_links_count);
+            const uint64_t first_shear_index = group.links.getDataID(first_shear);
+            pool.dispatch(height - 1, [&](uint64_t start, uint64_t end) {
+                for (uint32_t y = to<uint32_t>(start) + 1; y <= end; ++y) {
+                    const float max_elongation = getMaxElongation(y);
+                    uint64_t link = getRowFirstShearLink(y);
+                    for (uint32_t x = 1; x < width; ++x) {
+                        const civ::CompactID id = to<civ::CompactID>(first_particle + to<uint64_t>(y) * width + x);
+                        setLink(solver, group, first_shear_index + link, to<civ::CompactID>(first_shear + link),
+                                id - width - 1, id, shear_stiffness, max_elongation);
+                        ++link;
+                        setLink(solver, group, first_shear_index + link, to<civ::CompactID>(first_shear + link),
+                                id - width, id - 1, shear_stiffness, max_elongation);
+                        ++link;
+                    }
+                }
+            });
+        }
+
+        if (bend_links_count) {
+            LinkGroup& group = solver.bend_links;
+            const civ::CompactID first_bend = solver.addLinks(group, bend_links_count);
+            const uint64_t first_bend_index = group.links.getDataID(first_bend);
+            pool.dispatch(height, [&](uint64_t start, uint64_t end) {
+                for (uint32_t y = to<uint32_t>(start); y < end; ++y) {
+                    const float max_elongation = getMaxElongation(y);
+                    uint64_t link = getRowFirstBendLink(y);
+                    for (uint32_t x = 0; x < width; ++x) {
+                        const civ::CompactID id = to<civ::CompactID>(first_particle + to<uint64_t>(y) * width + x);
+                        if (x > 1) {
+                            setLink(solver, group, first_bend_index + link, to<civ::CompactID>(first_bend + link),
+                                    id - 2, id, bend_stiffness, max_elongation);
+                            ++link;
+                        }
+                        if (y > 1) {
+                            setLink(solver, group, first_bend_index + link, to<civ::CompactID>(first_bend + link),
+                                    id - 2 * width, id, bend_stiffness, max_elongation);
+                            ++link;
+                        }
+                    }
+                }
+            });
+        }
+    }
+
+private:
+    static void setLink(PhysicSolver& solver, uint64_t index, civ::CompactID link_id,
+                        civ::CompactID particle_1, civ::CompactID particle_2, float max_elongation_ratio)
+    {
+        solver.constraints.data[index] = LinkConstraint(solver.objects.getRef(particle_1), solver.objects.getRef(particle_2));
+        LinkInfo& info = solver.constraints.cold[index];
+        info.id = link_id;
+        info.max_elongation_ratio = max_elongation_ratio;
+        info.setRestDirection(solver.constraints.data[index]);
+    }
+
+    static void setLink(PhysicSolver& solver, LinkGroup& group, uint64_t index, civ::CompactID link_id,
+                        civ::CompactID particle_1, civ::CompactID particle_2, float stiffness, float max_elongation_ratio)
+    {
+        LinkConstraint& link = group.links.data[index];
+        link = LinkConstraint(solver.objects.getRef(particle_1), solver.objects.getRef(particle_2));
+        link.strength = stiffness;
+        LinkInfo& info = group.links.cold[index];
+        info.id = link_id;
+        info.max_elongation_ratio = max_elongation_ratio;
+        info.setRestDirection(link);
+    }
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
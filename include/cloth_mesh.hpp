@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "engine/physics/physics.hpp"
+#include "engine/render/conversions.hpp"
+
+/* Drawable geometry of the cloth: one vertex per particle, in the solver data
+ * order, and two vertex indices per link. Shared by the window renderer and
+ * the headless software rasterizer.
+ */
+struct ClothMesh
+{
+    std::vector<sf::Vertex> vertices;
+    std::vector<uint32_t> indices;
+    uint64_t topology_version;
+
+    explicit
+    ClothMesh(const PhysicSolver& solver)
+        : topology_version(solver.topology_version - 1)
+    {}
+
+    // Returns true if the topology changed since the last call
+    bool updateIndices(const PhysicSolver& solver)
+    {
+        if (topology_version == solver.topology_version) {
+            return false;
+        }
+        topology_version = solver.topology_version;
+        const uint64_t links_count = solver.constraints.size();
+        indices.resize(2 * links_count);
+        for (uint64_t i = 0; i < links_count; ++i) {
+            const LinkConstraint& link = solver.constraints.data[i];
+            indices[2 * i    ] = to<uint32_t>(solver.objects.getDataID(link.particle_1.getID()));
+            indices[2 * i + 1] = to<uint32_t>(solver.objects.getDataID(link.particle_2.getID()));
+        }
+        vertices.resize(solver.objects.size());
+        return true;
+    }
+
+    void updatePositions(const PhysicSolver& solver)
+    {
+        const uint64_t particles_count = solver.objects.size();
+        for (uint64_t i = 0; i < particles_count; ++i) {
+            vertices[i].position = toSf(solver.objects.data[i].position);
+        }
+    }
+
+    void updateColors(const PhysicSolver& solver)
+    {
+        const uint64_t particles_count = solver.objects.size();
+        for (uint64_t i = 0; i < particles_count; ++i) {
+            vertices[i].color = toSf(solver.objects.data[i].color);
+        }
+    }
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -1,3 +1,5 @@
+#pragma once
+
 /* Configuration management */
 
 /* JSON configuration format:
@@ -6,6 +8,17 @@
   "length": float,                  length of each link
   "friction": float,                friction coefficient
   "gravity": Vector2<float>,        gravity force vector
+  "integrator": "euler" | "verlet", integration scheme
+  "solver": "pbd" | "xpbd" | "pd",  constraint solver, pd needs a build with Eigen3
+  "stiffness": float,               links stiffness in xpbd and pd modes, inextensible if omitted
+  "warm_start": float,              share of the previous sub-step multipliers in [0, 1], xpbd, 0 by default
+  "shear": float,                   stiffness of the diagonal links in [0, 1], pbd only, 0 for none
+  "bend": float,                    stiffness of the skip-one links in [0, 1], pbd only, 0 for none
+  "substeps": int,                  sub-steps per frame
+  "iterations": int,                constraint solver iterations per sub-step
+  "attachments": bool,              long range attachments to the pinned particles, pbd and xpbd
+  "multigrid": int,                 coarse levels of the multigrid pass, pbd and xpbd, 0 to disable
+  "chebyshev": bool,                Chebyshev acceleration of the iterations, pbd with 3 or more
   "wind": [
     [
         Vector2<float>,             wind region width and height
@@ -40,8 +53,9 @@ the following default values:
 
 #include "engine/window_context_handler.hpp"
 #include "engine/physics/physics.hpp"
+#include "cloth_builder.hpp"
 #include "renderer.hpp"
-#include "wind.hpp"
+#include "engine/physics/wind.hpp"
 
 namespace po = boost::program_options;
 using json = nlohmann::json;
@@ -54,6 +68,7 @@ const float LINKS_LENGTH_DEFAULT = 20.0f;
 const float ERASE_RADIUS_DEFAULT = 10.0f;
 const float MOUSE_RADIUS_DEFAULT = 100.0f;
 const float MOUSE_FORCE_DEFAULT = 8000.0f;
+const uint32_t HEADLESS_FRAMES_DEFAULT = 600;
 
 /* Struct for maintaining command-line arguments */
 struct config {
@@ -77,6 +92,28 @@ struct config {
         , mouse_drag_radius(MOUSE_RADIUS_DEFAULT)
         , mouse_drag_force(MOUSE_FORCE_DEFAULT)
         , initial_zoom(BASE_ZOOM_DEFAULT)
+        , use_arena(false)
+        , huge_pages(false)
+        , render_lines(false)
+        , culling(true)
+        , level_of_detail(true)
+        , headless(false)
+        , frames_count(HEADLESS_FRAMES_DEFAULT)
+        , threads_count(0)
+        , capture_path()
+        , trace_path()
+        , perf_counters(false)
+        , integrator(Integrator::SemiImplicitEuler)
+        , constraint_solver(ConstraintSolver::PBD)
+        , compliance(0.0f)
+        , warm_start(WARM_START_DEFAULT)
+        , shear_stiffness(0.0f)
+        , bend_stiffness(0.0f)
+        , sub_steps(SUB_STEPS_DEFAULT)
+        , solver_iterations(SOLVER_ITERATIONS_DEFAULT)
+        , long_range_attachments(false)
+        , multigrid_levels(0)
+        , chebyshev(false)
         , cloth_definition_path()
     {}
     /* command-line variables */
@@ -94,6 +131,31 @@ struct config {
     float mouse_drag_radius;
     float mouse_drag_force;
     float initial_zoom;
+    bool use_arena;
+    bool huge_pages;
+    bool render_lines;
+    bool culling;
+    bool level_of_detail;
+    bool headless;
+    uint32_t frames_count;
+    uint32_t threads_count;
+    std::string capture_path;
+    std::string trace_path;
+    bool perf_counters;
+    Integrator integrator;
+    ConstraintSolver constraint_solver;
+    // Inverse of the links stiffness, only used by xpbd and pd
+    float compliance;
+    // Share of the previous sub-step xpbd multipliers to start from, 0 for none
+    float warm_start;
+    // Share of the correction applied by the shear and bend links, 0 for none
+    float shear_stiffness;
+    float bend_stiffness;
+    uint32_t sub_steps;
+    uint32_t solver_iterations;
+    bool long_range_attachments;
+    uint32_t multigrid_levels;
+    bool chebyshev;
     std::string cloth_definition_path;
     std::vector<Wind> winds;
 
@@ -106,6 +168,12 @@ struct config {
     /* Build the cloth based on the current configuration */
     void buildCloth(PhysicSolver& solver) const;
 
+    /* Add the configured winds, or the default ones */
+    void buildWind(WindManager& wind) const;
+
+    /* Select the solver kernel matching the configuration */
+    void setupSolver(PhysicSolver& solver) const;
+
     /* Dump the current values to the given ostream */
     void print(std::ostream& os) const;
 
@@ -0,0 +1,180 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <vector>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+
+namespace civ
+{
+
+constexpr uint64_t ARENA_ALIGNMENT = 64;
+constexpr uint64_t HUGE_PAGE_SIZE  = 2 * 1024 * 1024;
+
+/* Bump allocator handing out 64-byte aligned blocks from large chunks.
+ *
+ * Memory is only given back when the arena is destroyed (except for the last
+ * block, which can be shrunk back), so containers using it should reserve
+ * their final size up front. With huge_pages the chunks are aligned on 2MB
+ * and advised as transparent huge pages on Linux.
+ */
+struct Arena
+{
+    struct Chunk
+    {
+        uint8_t* memory;
+        uint64_t size;
+    };
+
+    std::vector<Chunk> chunks;
+    uint64_t chunk_size;
+    uint64_t top;
+    bool     huge_pages;
+
+    explicit
+    Arena(uint64_t initial_size = HUGE_PAGE_SIZE, bool use_huge_pages = false)
+        : chunk_size(initial_size)
+        , top(0)
+        , huge_pages(use_huge_pages)
+    {
+        addChunk(initial_size);
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena()
+    {
+        for (const Chunk& chunk : chunks) {
+            freeChunk(chunk);
+        }
+    }
+
+    void* allocate(uint64_t size)
+    {
+        const uint64_t aligned_size = alignSize(size, ARENA_ALIGNMENT);
+        if (top + aligned_size > chunks.back().size) {
+            addChunk(std::max(aligned_size, chunk_size));
+        }
+        void* block = chunks.back().memory + top;
+        top += aligned_size;
+        return block;
+    }
+
+    void deallocate(void* block, uint64_t size)
+    {
+        // Only the most recent block can be reclaimed
+        const Chunk& chunk = chunks.back();
+        const uint64_t aligned_size = alignSize(size, ARENA_ALIGNMENT);
+        if (static_cast<uint8_t*>(block) + aligned_size == chunk.memory + top) {
+            top -= aligned_size;
+        }
+    }
+
+    uint64_t getUsedBytes() const
+    {
+        uint64_t used = top;
+        for (uint64_t i(0); i + 1 < chunks.size(); ++i) {
+            used += chunks[i].size;
+        }
+        return used;
+    }
+
+    static uint64_t alignSize(uint64_t size, uint64_t alignment)
+    {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+private:
+    void addChunk(uint64_t size)
+    {
+        const uint64_t alignment = huge_pages ? HUGE_PAGE_SIZE : ARENA_ALIGNMENT;
+        const uint64_t aligned_size = alignSize(std::max<uint64_t>(size, 1), alignment);
+#if defined(_WIN32)
+        void* memory = _aligned_malloc(aligned_size, alignment);
+#else
+        void* memory = std::aligned_alloc(alignment, aligned_size);
+#endif
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        if (huge_pages) {
+            // Best effort, THP may be disabled system-wide
+            madvise(memory, aligned_size, MADV_HUGEPAGE);
+        }
+#endif
+        chunks.push_back({static_cast<uint8_t*>(memory), aligned_size});
+        top = 0;
+    }
+
+    static void freeChunk(const Chunk& chunk)
+    {
+#if defined(_WIN32)
+        _aligned_free(chunk.memory);
+#else
+        std::free(chunk.memory);
+#endif
+    }
+};
+
+
+/* Standard allocator drawing from an Arena, or from the heap when no arena is
+ * bound, so that containers can opt in at runtime without changing type.
+ */
+template<typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    Arena* arena;
+
+    ArenaAllocator(Arena* a = nullptr) noexcept
+        : arena(a)
+    {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept
+        : arena(other.arena)
+    {}
+
+    T* allocate(std::size_t n)
+    {
+        if (arena) {
+            return static_cast<T*>(arena->allocate(n * sizeof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        if (arena) {
+            arena->deallocate(p, n * sizeof(T));
+        } else {
+            ::operator delete(p);
+        }
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return a.arena == b.arena;
+}
+
+template<typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return a.arena != b.arena;
+}
+
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */
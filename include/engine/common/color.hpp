@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+
+
+/* 8 bits per channel color, same layout as sf::Color */
+struct Color
+{
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t a;
+
+    constexpr Color()
+        : r(0)
+        , g(0)
+        , b(0)
+        , a(255)
+    {}
+
+    constexpr Color(uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha = 255)
+        : r(red)
+        , g(green)
+        , b(blue)
+        , a(alpha)
+    {}
+
+    static constexpr Color white()
+    {
+        return Color(255, 255, 255);
+    }
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
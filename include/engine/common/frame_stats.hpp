@@ -0,0 +1,127 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include "racc.hpp"
+
+// Rolling window, 10 seconds at 60 fps
+const uint32_t FRAME_STATS_WINDOW = 600;
+// Histogram buckets of 0.1 ms up to 100 ms, slower frames share the last one
+const float FRAME_STATS_BUCKET_MS = 0.1f;
+const uint32_t FRAME_STATS_BUCKETS = 1000;
+
+using FrameClock = std::chrono::steady_clock;
+
+inline float getElapsedMs(FrameClock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(FrameClock::now() - start).count();
+}
+
+
+/* Frame time distribution of one stage, over the rolling window and since the
+ * start of the run. Tail latency matters more than the mean here. */
+struct FrameTimeSeries
+{
+    std::string name;
+    RHistogram<float> window;
+    Histogram<float> run;
+    double run_sum;
+
+    explicit
+    FrameTimeSeries(const std::string& series_name)
+        : name(series_name)
+        , window(FRAME_STATS_WINDOW, FRAME_STATS_BUCKET_MS, FRAME_STATS_BUCKETS)
+        , run(FRAME_STATS_BUCKET_MS, FRAME_STATS_BUCKETS)
+        , run_sum(0.0)
+    {}
+
+    float getRunMean() const
+    {
+        return run.total ? static_cast<float>(run_sum / static_cast<double>(run.total)) : 0.0f;
+    }
+
+    void addValue(float ms)
+    {
+        window.addValue(ms);
+        run.add(ms);
+        run_sum += ms;
+    }
+};
+
+
+struct FrameStats
+{
+    FrameTimeSeries physics;
+    FrameTimeSeries render;
+    FrameTimeSeries total;
+    uint64_t frames_count;
+
+    FrameStats()
+        : physics("physics")
+        , render("render")
+        , total("total")
+        , frames_count(0)
+    {}
+
+    void addFrame(float physics_ms, float render_ms, float total_ms)
+    {
+        physics.addValue(physics_ms);
+        render.addValue(render_ms);
+        total.addValue(total_ms);
+        ++frames_count;
+    }
+
+    // Statistics over the last FRAME_STATS_WINDOW frames
+    void printWindow(std::ostream& os) const
+    {
+        const std::ios::fmtflags flags = os.flags();
+        const std::streamsize precision = os.precision();
+        os << "frame times over the last " << total.window.getCount() << " frames (ms):\n";
+        printHeader(os);
+        for (const FrameTimeSeries* series : {&physics, &render, &total}) {
+            const RHistogram<float>& w = series->window;
+            printRow(os, series->name, w.getMean(), w.getPercentile(0.5f), w.getPercentile(0.95f),
+                     w.getPercentile(0.99f), w.getMax());
+        }
+        os.flags(flags);
+        os.precision(precision);
+        os << std::flush;
+    }
+
+    // Statistics since the start
+    void printRun(std::ostream& os) const
+    {
+        const std::ios::fmtflags flags = os.flags();
+        const std::streamsize precision = os.precision();
+        os << "frame times over " << frames_count << " frames (ms):\n";
+        printHeader(os);
+        for (const FrameTimeSeries* series : {&physics, &render, &total}) {
+            const Histogram<float>& h = series->run;
+            printRow(os, series->name, series->getRunMean(), h.getPercentile(0.5f), h.getPercentile(0.95f),
+                     h.getPercentile(0.99f), h.max);
+        }
+        os.flags(flags);
+        os.precision(precision);
+        os << std::flush;
+    }
+
+private:
+    static void printHeader(std::ostream& os)
+    {
+        os << std::left << std::setw(10) << "stage" << std::right
+           << std::setw(9) << "mean" << std::setw(9) << "p50" << std::setw(9) << "p95"
+           << std::setw(9) << "p99" << std::setw(9) << "max" << "\n";
+    }
+
+    static void printRow(std::ostream& os, const std::string& name, float mean, float p50, float p95,
+                         float p99, float max)
+    {
+        os << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(2)
+           << std::setw(9) << mean << std::setw(9) << p50 << std::setw(9) << p95
+           << std::setw(9) << p99 << std::setw(9) << max << "\n";
+    }
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -1,20 +1,29 @@
 #pragma once
+#include <cstring>
+#include <iterator>
 #include <vector>
+#include "arena.hpp"
 
 
 namespace civ
 {
 
 using ID = uint64_t;
+// Compact IDs halve the index and metadata tables, enough for up to 4G objects
+using CompactID = uint32_t;
 
-template<typename T>
+template<typename T, typename TID>
+struct Vector;
+
+template<typename T, typename TID = ID>
 struct Ref;
 
 
-struct Slot
+template<typename TID>
+struct BasicSlot
 {
-    ID id;
-    ID data_id;
+    TID id;
+    uint64_t data_id;
 };
 
 
@@ -44,83 +53,123 @@ struct ObjectSlotConst
 };
 
 
-struct SlotMetadata
+/* Per data slot: ID of the object and generation (op_id) of the slot.
+ * A Ref stores the same pair, so checking its validity is a single compare,
+ * one 64-bit word with compact IDs.
+ */
+template<typename TID>
+struct BasicSlotMetadata
 {
-    ID rid;
-    ID op_id;
+    TID rid;
+    TID op_id;
+
+    bool operator==(const BasicSlotMetadata& other) const
+    {
+        if constexpr (sizeof(BasicSlotMetadata) == sizeof(uint64_t)) {
+            uint64_t a, b;
+            std::memcpy(&a, this, sizeof(uint64_t));
+            std::memcpy(&b, &other, sizeof(uint64_t));
+            return a == b;
+        } else {
+            return rid == other.rid && op_id == other.op_id;
+        }
+    }
 };
 
+using Slot         = BasicSlot<ID>;
+using SlotMetadata = BasicSlotMetadata<ID>;
+using Handle       = BasicSlotMetadata<ID>;
+using CompactSlotMetadata = BasicSlotMetadata<CompactID>;
+using CompactHandle       = BasicSlotMetadata<CompactID>;
 
-template<typename T>
+
+template<typename T, typename TID = ID>
 struct Vector
 {
+    using IDType         = TID;
+    using Slot           = BasicSlot<TID>;
+    using SlotMetadata   = BasicSlotMetadata<TID>;
+    using DataVector     = std::vector<T, ArenaAllocator<T>>;
+    using IDVector       = std::vector<TID, ArenaAllocator<TID>>;
+    using MetadataVector = std::vector<SlotMetadata, ArenaAllocator<SlotMetadata>>;
+
     Vector()
         : data_size(0)
         , op_count(0)
     {}
     // Data ADD / REMOVE
     template<typename... Args>
-    ID emplace_back(Args&&... args);
-    ID push_back(const T& obj);
-    void erase(uint64_t id);
+    TID emplace_back(Args&&... args);
+    TID push_back(const T& obj);
+    void erase(TID id);
+    // Swaps two places of the data array, IDs and references follow their objects
+    void swapData(uint64_t i, uint64_t j);
+    // Bulk ADD: creates count default constructed objects with contiguous IDs
+    // and contiguous data, returns the ID of the first one
+    TID allocate(uint64_t count);
+    // Reserve memory for a total of count objects
+    void reserve(uint64_t count);
+    // Moves the storage into the given arena (nullptr = heap), existing objects are kept
+    void setArena(Arena* arena);
     // Data access by ID
-    T& operator[](ID id);
-    const T& operator[](ID id) const;
+    T& operator[](TID id);
+    const T& operator[](TID id) const;
     // Returns a standalone object allowing access to the underlying data
-    Ref<T> getRef(ID id);
+    Ref<T, TID> getRef(TID id);
     // Returns the data at a specific place in the data vector (not an ID)
     T& getDataAt(uint64_t i);
     // Check if the data behind the pointer is the same
-    bool isValid(ID id, ID validity) const;
+    bool isValid(TID id, TID validity) const;
+    bool isValid(const SlotMetadata& handle) const;
     // Returns the ith object and id
     ObjectSlot<T> getSlotAt(uint64_t i);
     ObjectSlotConst<T> getSlotAt(uint64_t i) const;
     // Iterators
-    typename std::vector<T>::iterator begin();
-    typename std::vector<T>::iterator end();
-    typename std::vector<T>::const_iterator begin() const;
-    typename std::vector<T>::const_iterator end() const;
+    typename DataVector::iterator begin();
+    typename DataVector::iterator end();
+    typename DataVector::const_iterator begin() const;
+    typename DataVector::const_iterator end() const;
     // Number of objects in the array
     uint64_t size() const;
 
 public:
-    std::vector<T>            data;
-    std::vector<uint64_t>     ids;
-    std::vector<SlotMetadata> metadata;
-    uint64_t                  data_size;
-    uint64_t                  op_count;
+    DataVector     data;
+    IDVector       ids;
+    MetadataVector metadata;
+    uint64_t       data_size;
+    TID            op_count;
 
     bool isFull() const;
     // Returns the ID of the ith element of the data array
-    ID getID(uint64_t i) const;
+    TID getID(uint64_t i) const;
     // Returns the data emplacement of an ID
-    uint64_t getDataID(ID id) const;
+    uint64_t getDataID(TID id) const;
     Slot createNewSlot();
     Slot getFreeSlot();
     Slot getSlot();
-    SlotMetadata& getMetadataAt(ID id);
+    SlotMetadata& getMetadataAt(TID id);
     const T& getAt(uint64_t id) const;
 };
 
-template<typename T>
+template<typename T, typename TID>
 template<typename ...Args>
-inline uint64_t Vector<T>::emplace_back(Args&& ...args)
+inline TID Vector<T, TID>::emplace_back(Args&& ...args)
 {
     const Slot slot = getSlot();
     new(&data[slot.data_id]) T(args...);
     return slot.id;
 }
 
-template<typename T>
-inline uint64_t Vector<T>::push_back(const T& obj)
+template<typename T, typename TID>
+inline TID Vector<T, TID>::push_back(const T& obj)
 {
     const Slot slot = getSlot();
     data[slot.data_id] = obj;
     return slot.id;
 }
 
-template<typename T>
-inline void Vector<T>::erase(ID id)
+template<typename T, typename TID>
+inline void Vector<T, TID>::erase(TID id)
 {
     // Retrieve the object position in data
     const uint64_t data_index = ids[id];
@@ -128,7 +177,7 @@ inline void Vector<T>::erase(ID id)
     if (data_index >= data_size) { return; }
     // Swap the object at the end
     --data_size;
-    const uint64_t last_id = metadata[data_size].rid;
+    const TID last_id = metadata[data_size].rid;
     std::swap(data[data_size], data[data_index]);
     std::swap(metadata[data_size], metadata[data_index]);
     std::swap(ids[last_id], ids[id]);
@@ -136,176 +185,348 @@ inline void Vector<T>::erase(ID id)
     metadata[data_size].op_id = ++op_count;
 }
 
-template<typename T>
-inline T& Vector<T>::operator[](ID id)
+template<typename T, typename TID>
+inline void Vector<T, TID>::swapData(uint64_t i, uint64_t j)
+{
+    std::swap(data[i], data[j]);
+    std::swap(metadata[i], metadata[j]);
+    ids[metadata[i].rid] = static_cast<TID>(i);
+    ids[metadata[j].rid] = static_cast<TID>(j);
+}
+
+template<typename T, typename TID>
+inline TID Vector<T, TID>::allocate(uint64_t count)
+{
+    const uint64_t capacity = data.size();
+    const TID first_id = static_cast<TID>(capacity);
+    data.resize(capacity + count);
+    ids.resize(capacity + count);
+    metadata.resize(capacity + count);
+    // Shift free slots after the new objects to keep the live data contiguous
+    for (uint64_t i(capacity); i-- > data_size;) {
+        const uint64_t target = i + count;
+        std::swap(data[i], data[target]);
+        metadata[target] = metadata[i];
+        ids[metadata[target].rid] = static_cast<TID>(target);
+    }
+    for (uint64_t i(0); i < count; ++i) {
+        const uint64_t data_index = data_size + i;
+        const TID id = static_cast<TID>(first_id + i);
+        metadata[data_index] = {id, op_count++};
+        ids[id] = static_cast<TID>(data_index);
+    }
+    data_size += count;
+    return first_id;
+}
+
+template<typename T, typename TID>
+inline void Vector<T, TID>::reserve(uint64_t count)
+{
+    data.reserve(count);
+    ids.reserve(count);
+    metadata.reserve(count);
+}
+
+template<typename T, typename TID>
+inline void Vector<T, TID>::setArena(Arena* arena)
+{
+    // Reallocate with the new allocator, keeping the current capacity
+    DataVector new_data{ArenaAllocator<T>(arena)};
+    new_data.reserve(data.capacity());
+    new_data.insert(new_data.end(), std::make_move_iterator(data.begin()), std::make_move_iterator(data.end()));
+    IDVector new_ids{ArenaAllocator<TID>(arena)};
+    new_ids.reserve(ids.capacity());
+    new_ids.insert(new_ids.end(), ids.begin(), ids.end());
+    MetadataVector new_metadata{ArenaAllocator<SlotMetadata>(arena)};
+    new_metadata.reserve(metadata.capacity());
+    new_metadata.insert(new_metadata.end(), metadata.begin(), metadata.end());
+    data     = std::move(new_data);
+    ids      = std::move(new_ids);
+    metadata = std::move(new_metadata);
+}
+
+template<typename T, typename TID>
+inline T& Vector<T, TID>::operator[](TID id)
 {
     return const_cast<T&>(getAt(id));
 }
 
-template<typename T>
-inline const T& Vector<T>::operator[](ID id) const
+template<typename T, typename TID>
+inline const T& Vector<T, TID>::operator[](TID id) const
 {
     return getAt(id);
 }
 
-template<typename T>
-inline ObjectSlot<T> Vector<T>::getSlotAt(uint64_t i)
+template<typename T, typename TID>
+inline ObjectSlot<T> Vector<T, TID>::getSlotAt(uint64_t i)
 {
     return ObjectSlot<T>(metadata[i].rid, &data[i]);
 }
 
-template<typename T>
-inline ObjectSlotConst<T> Vector<T>::getSlotAt(uint64_t i) const
+template<typename T, typename TID>
+inline ObjectSlotConst<T> Vector<T, TID>::getSlotAt(uint64_t i) const
 {
     return ObjectSlotConst<T>(metadata[i].rid, &data[i]);
 }
 
-template<typename T>
-inline Ref<T> Vector<T>::getRef(ID id)
+template<typename T, typename TID>
+inline Ref<T, TID> Vector<T, TID>::getRef(TID id)
 {
-    return Ref<T>(id, this, metadata[ids[id]].op_id);
+    return Ref<T, TID>(this, metadata[ids[id]]);
 }
 
-template<typename T>
-inline T& Vector<T>::getDataAt(uint64_t i)
+template<typename T, typename TID>
+inline T& Vector<T, TID>::getDataAt(uint64_t i)
 {
     return data[i];
 }
 
-template<typename T>
-inline uint64_t Vector<T>::getID(uint64_t i) const
+template<typename T, typename TID>
+inline TID Vector<T, TID>::getID(uint64_t i) const
 {
     return metadata[i].rid;
 }
 
-template<typename T>
-inline uint64_t Vector<T>::size() const
+template<typename T, typename TID>
+inline uint64_t Vector<T, TID>::size() const
 {
     return data_size;
 }
 
-template<typename T>
-inline typename std::vector<T>::iterator Vector<T>::begin()
+template<typename T, typename TID>
+inline typename Vector<T, TID>::DataVector::iterator Vector<T, TID>::begin()
 {
     return data.begin();
 }
 
-template<typename T>
-inline typename std::vector<T>::iterator Vector<T>::end()
+template<typename T, typename TID>
+inline typename Vector<T, TID>::DataVector::iterator Vector<T, TID>::end()
 {
     return data.begin() + data_size;
 }
 
-template<typename T>
-inline typename std::vector<T>::const_iterator Vector<T>::begin() const
+template<typename T, typename TID>
+inline typename Vector<T, TID>::DataVector::const_iterator Vector<T, TID>::begin() const
 {
     return data.begin();
 }
 
-template<typename T>
-inline typename std::vector<T>::const_iterator Vector<T>::end() const
+template<typename T, typename TID>
+inline typename Vector<T, TID>::DataVector::const_iterator Vector<T, TID>::end() const
 {
     return data.begin() + data_size;
 }
 
-template<typename T>
-inline bool Vector<T>::isFull() const
+template<typename T, typename TID>
+inline bool Vector<T, TID>::isFull() const
 {
     return data_size == data.size();
 }
 
-template<typename T>
-inline Slot Vector<T>::createNewSlot()
+template<typename T, typename TID>
+inline typename Vector<T, TID>::Slot Vector<T, TID>::createNewSlot()
 {
+    const TID id = static_cast<TID>(data_size);
     data.emplace_back();
-    ids.push_back(data_size);
-    metadata.push_back({data_size, op_count++});
-    return { data_size, data_size };
+    ids.push_back(id);
+    metadata.push_back({id, op_count++});
+    return { id, data_size };
 }
 
-template<typename T>
-inline Slot Vector<T>::getFreeSlot()
+template<typename T, typename TID>
+inline typename Vector<T, TID>::Slot Vector<T, TID>::getFreeSlot()
 {
-    const uint64_t reuse_id = metadata[data_size].rid;
+    const TID reuse_id = metadata[data_size].rid;
     metadata[data_size].op_id = op_count++;
     return { reuse_id, data_size };
 }
 
-template<typename T>
-inline Slot Vector<T>::getSlot()
+template<typename T, typename TID>
+inline typename Vector<T, TID>::Slot Vector<T, TID>::getSlot()
 {
     const Slot slot = isFull() ? createNewSlot() : getFreeSlot();
     ++data_size;
     return slot;
 }
 
-template<typename T>
-inline SlotMetadata& Vector<T>::getMetadataAt(ID id)
+template<typename T, typename TID>
+inline typename Vector<T, TID>::SlotMetadata& Vector<T, TID>::getMetadataAt(TID id)
 {
     return metadata[getDataID(id)];
 }
 
-template<typename T>
-inline uint64_t Vector<T>::getDataID(ID id) const
+template<typename T, typename TID>
+inline uint64_t Vector<T, TID>::getDataID(TID id) const
 {
     return ids[id];
 }
 
-template<typename T>
-inline const T& Vector<T>::getAt(ID id) const
+template<typename T, typename TID>
+inline const T& Vector<T, TID>::getAt(uint64_t id) const
 {
     return data[getDataID(id)];
 }
 
-template<typename T>
-inline bool Vector<T>::isValid(ID id, uint64_t validity) const
+template<typename T, typename TID>
+inline bool Vector<T, TID>::isValid(TID id, TID validity) const
 {
     return validity == metadata[getDataID(id)].op_id;
 }
 
+template<typename T, typename TID>
+inline bool Vector<T, TID>::isValid(const SlotMetadata& handle) const
+{
+    return metadata[getDataID(handle.rid)] == handle;
+}
+
 
-template<typename T>
+/* Vector with a second column of data stored in a parallel array, so that
+ * rarely used (cold) fields do not pollute the cache lines of the hot ones.
+ * The cold column follows the hot one in every move, cold[i] always belongs
+ * to data[i]. Operations must go through SplitVector to keep them in sync.
+ */
+template<typename T, typename U, typename TID = ID>
+struct SplitVector : public Vector<T, TID>
+{
+    using Base       = Vector<T, TID>;
+    using ColdVector = std::vector<U, ArenaAllocator<U>>;
+
+    ColdVector cold;
+
+    template<typename... Args>
+    TID emplace_back(Args&&... args)
+    {
+        const TID id = Base::emplace_back(std::forward<Args>(args)...);
+        cold.resize(Base::data.size());
+        cold[Base::getDataID(id)] = U();
+        return id;
+    }
+
+    TID push_back(const T& obj, const U& cold_obj = U())
+    {
+        const TID id = Base::push_back(obj);
+        cold.resize(Base::data.size());
+        cold[Base::getDataID(id)] = cold_obj;
+        return id;
+    }
+
+    void erase(TID id)
+    {
+        const uint64_t data_index = Base::ids[id];
+        if (data_index < Base::data_size) {
+            std::swap(cold[Base::data_size - 1], cold[data_index]);
+        }
+        Base::erase(id);
+    }
+
+    void swapData(uint64_t i, uint64_t j)
+    {
+        std::swap(cold[i], cold[j]);
+        Base::swapData(i, j);
+    }
+
+    TID allocate(uint64_t count)
+    {
+        // Mirror the free slots shift done by Vector::allocate
+        const uint64_t capacity = Base::data.size();
+        cold.resize(capacity + count);
+        for (uint64_t i(capacity); i-- > Base::data_size;) {
+            std::swap(cold[i], cold[i + count]);
+        }
+        for (uint64_t i(0); i < count; ++i) {
+            cold[Base::data_size + i] = U();
+        }
+        return Base::allocate(count);
+    }
+
+    void reserve(uint64_t count)
+    {
+        Base::reserve(count);
+        cold.reserve(count);
+    }
+
+    void setArena(Arena* arena)
+    {
+        Base::setArena(arena);
+        ColdVector new_cold{ArenaAllocator<U>(arena)};
+        new_cold.reserve(cold.capacity());
+        new_cold.insert(new_cold.end(), std::make_move_iterator(cold.begin()), std::make_move_iterator(cold.end()));
+        cold = std::move(new_cold);
+    }
+
+    U& getCold(TID id)
+    {
+        return cold[Base::getDataID(id)];
+    }
+
+    U& getColdAt(uint64_t i)
+    {
+        return cold[i];
+    }
+};
+
+
+template<typename T, typename TID>
 struct Ref
 {
+    using Handle = BasicSlotMetadata<TID>;
+
     Ref()
-        : id(0)
-        , array(nullptr)
-        , validity_id(0)
+        : array(nullptr)
+        , handle{0, 0}
     {}
 
-    Ref(ID id_, Vector<T>* a, ID vid)
-        : id(id_)
-        , array(a)
-        , validity_id(vid)
+    Ref(Vector<T, TID>* a, Handle h)
+        : array(a)
+        , handle(h)
+    {}
+
+    Ref(TID id_, Vector<T, TID>* a, TID vid)
+        : array(a)
+        , handle{id_, vid}
     {}
 
     T* operator->()
     {
-        return &(*array)[id];
+        return &(*array)[handle.rid];
     }
 
     T& operator*()
     {
-        return (*array)[id];
+        return (*array)[handle.rid];
     }
 
     const T& operator*() const
     {
-        return (*array)[id];
+        return (*array)[handle.rid];
     }
 
     explicit
     operator bool() const
     {
-        return array && array->isValid(id, validity_id);
+        return array && array->isValid(handle);
+    }
+
+    TID getID() const
+    {
+        return handle.rid;
     }
 
 private:
-    ID         id;
-    Vector<T>* array;
-    ID         validity_id;
+    Vector<T, TID>* array;
+    Handle          handle;
 };
 
+
+template<typename T>
+using CompactVector = Vector<T, CompactID>;
+
+template<typename T>
+using CompactRef = Ref<T, CompactID>;
+
+template<typename T, typename U>
+using CompactSplitVector = SplitVector<T, U, CompactID>;
+
 }
 
 /* vim: set ts=4 sts=4 sw=4 et: */
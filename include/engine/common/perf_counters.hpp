@@ -0,0 +1,313 @@
+#pragma once
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+
+/* Hardware performance counters around code phases, using Linux perf_event_open.
+ *
+ * The counters are opened as a single group on the calling thread, so that
+ * one read returns all of them. Counters the kernel refuses are skipped, and
+ * if none can be opened (containers, VMs, perf_event_paranoid) every phase is
+ * a no-op. Phases are opened with PERF_SCOPE(name, elements_count), where the
+ * elements count (particles, links) is used to report per-element figures.
+ *
+ * When the PMU has fewer counters than requested, the kernel time-shares the
+ * group with other events. Counts are then scaled by the share of the phase
+ * the group was running, and calls during which it never ran are reported
+ * apart rather than as zeros.
+ *
+ * Everything compiles to nothing unless CLOTH_PERF_COUNTERS is defined, see
+ * the CLOTH_PERF_COUNTERS CMake option.
+ */
+namespace perf
+{
+
+enum Event
+{
+    Cycles = 0,
+    Instructions,
+    L1DMisses,
+    LLCMisses,
+    BranchMisses,
+    EventsCount
+};
+
+const char* const EVENT_NAMES[EventsCount] = {
+    "cycles", "instructions", "L1d misses", "LLC misses", "branch misses"
+};
+
+
+struct Sample
+{
+    // Time the group was enabled and actually counting, in nanoseconds
+    uint64_t time_enabled = 0;
+    uint64_t time_running = 0;
+    uint64_t values[EventsCount] = {};
+};
+
+
+struct Phase
+{
+    const char* name = nullptr;
+    uint64_t    calls = 0;
+    // Calls during which the group was never scheduled, left out of the figures
+    uint64_t    missed_calls = 0;
+    uint64_t    elements = 0;
+    // Estimated counts, scaled up when the group was multiplexed
+    double      totals[EventsCount] = {};
+};
+
+
+struct Counters
+{
+    int              fds[EventsCount];
+    // Position of each event in the group read, -1 if not available
+    int              slots[EventsCount];
+    int              leader;
+    uint32_t         opened;
+    bool             enabled;
+    std::deque<Phase> phases;
+
+    Counters()
+        : leader(-1)
+        , opened(0)
+        , enabled(false)
+    {
+        for (uint32_t i(0); i < EventsCount; ++i) {
+            fds[i] = -1;
+            slots[i] = -1;
+        }
+    }
+
+    Counters(const Counters&) = delete;
+    Counters& operator=(const Counters&) = delete;
+
+    ~Counters()
+    {
+        close();
+    }
+
+    static Counters& get()
+    {
+        static Counters counters;
+        return counters;
+    }
+
+    // Returns false and describes the reason when no counter is available
+    bool open(std::ostream& log)
+    {
+#ifdef __linux__
+        const uint64_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D
+                                     | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                     | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        const uint32_t types[EventsCount] = {
+            PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+        };
+        const uint64_t configs[EventsCount] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, l1d_read_miss,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+        };
+        int error = 0;
+        for (uint32_t i(0); i < EventsCount; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[i];
+            attr.config = configs[i];
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.disabled = leader < 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+            if (fd < 0) {
+                error = errno;
+                log << "perf counter " << EVENT_NAMES[i] << " unavailable: " << std::strerror(error) << "\n";
+                continue;
+            }
+            if (leader < 0) {
+                leader = fd;
+            }
+            fds[i] = fd;
+            slots[i] = static_cast<int>(opened++);
+        }
+        if (leader < 0) {
+            return false;
+        }
+        ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        enabled = true;
+        return true;
+#else
+        log << "perf counters are only supported on Linux\n";
+        return false;
+#endif
+    }
+
+    void close()
+    {
+#ifdef __linux__
+        for (int& fd : fds) {
+            if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+#endif
+        leader = -1;
+        opened = 0;
+        enabled = false;
+    }
+
+    bool read(Sample& sample) const
+    {
+#ifdef __linux__
+        // Group read format: events count, enabled and running times, then the
+        // values in opening order
+        uint64_t buffer[EventsCount + 3];
+        const ssize_t size = ::read(leader, buffer, sizeof(buffer));
+        if (size < static_cast<ssize_t>(sizeof(uint64_t) * (opened + 3))) {
+            return false;
+        }
+        sample.time_enabled = buffer[1];
+        sample.time_running = buffer[2];
+        for (uint32_t i(0); i < EventsCount; ++i) {
+            sample.values[i] = slots[i] < 0 ? 0 : buffer[slots[i] + 3];
+        }
+        return true;
+#else
+        (void)sample;
+        return false;
+#endif
+    }
+
+    // Phases are identified by name, each specialization of a templated pass
+    // resolves its own reference to the same phase
+    Phase& getPhase(const char* name)
+    {
+        for (Phase& phase : phases) {
+            if (std::strcmp(phase.name, name) == 0) {
+                return phase;
+            }
+        }
+        Phase& phase = phases.emplace_back();
+        phase.name = name;
+        return phase;
+    }
+
+    void print(std::ostream& os) const
+    {
+        if (!enabled) {
+            return;
+        }
+        const std::ios::fmtflags flags = os.flags();
+        const std::streamsize precision = os.precision();
+        os << "hardware counters per processed element (particle or link):\n"
+           << std::left << std::setw(16) << "phase" << std::right << std::setw(10) << "calls";
+        for (uint32_t i(0); i < EventsCount; ++i) {
+            if (slots[i] >= 0) {
+                os << std::setw(15) << EVENT_NAMES[i];
+            }
+        }
+        os << std::setw(8) << "IPC" << "\n";
+        bool missed = false;
+        for (const Phase& phase : phases) {
+            missed |= phase.missed_calls > 0;
+            const double elements = static_cast<double>(phase.elements ? phase.elements : 1);
+            os << std::left << std::setw(16) << phase.name << std::right << std::setw(10) << phase.calls
+               << std::fixed << std::setprecision(3);
+            for (uint32_t i(0); i < EventsCount; ++i) {
+                if (slots[i] >= 0) {
+                    os << std::setw(15) << phase.totals[i] / elements;
+                }
+            }
+            if (slots[Cycles] >= 0 && slots[Instructions] >= 0 && phase.totals[Cycles] > 0.0) {
+                os << std::setw(8) << std::setprecision(2)
+                   << phase.totals[Instructions] / phase.totals[Cycles];
+            } else {
+                os << std::setw(8) << "-";
+            }
+            os << "\n";
+        }
+        if (missed) {
+            os << "calls left out, the counters were busy with other events during them:\n";
+            for (const Phase& phase : phases) {
+                if (phase.missed_calls) {
+                    os << "  " << phase.name << ": " << phase.missed_calls << " of " << phase.calls << "\n";
+                }
+            }
+        }
+        os.flags(flags);
+        os.precision(precision);
+        os << std::flush;
+    }
+};
+
+
+struct Scope
+{
+    Counters& counters;
+    Phase&    phase;
+    uint64_t  elements;
+    Sample    start;
+    bool      valid;
+
+    Scope(Phase& p, uint64_t elements_count)
+        : counters(Counters::get())
+        , phase(p)
+        , elements(elements_count)
+        , valid(counters.enabled && counters.read(start))
+    {}
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope()
+    {
+        Sample end;
+        if (!valid || !counters.read(end)) {
+            return;
+        }
+        ++phase.calls;
+        const uint64_t running = end.time_running - start.time_running;
+        if (!running) {
+            ++phase.missed_calls;
+            return;
+        }
+        // Extrapolates the counts to the whole phase when the group was multiplexed
+        const double scale = static_cast<double>(end.time_enabled - start.time_enabled) / static_cast<double>(running);
+        for (uint32_t i(0); i < EventsCount; ++i) {
+            phase.totals[i] += static_cast<double>(end.values[i] - start.values[i]) * scale;
+        }
+        phase.elements += elements;
+    }
+};
+
+}
+
+#define PERF_CONCAT_IMPL(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_IMPL(a, b)
+
+#ifdef CLOTH_PERF_COUNTERS
+    #define PERF_SCOPE(name, elements_count) \
+        static perf::Phase& PERF_CONCAT(perf_phase_, __LINE__) = perf::Counters::get().getPhase(name); \
+        const perf::Scope PERF_CONCAT(perf_scope_, __LINE__)(PERF_CONCAT(perf_phase_, __LINE__), elements_count)
+    #define PERF_OPEN(log) perf::Counters::get().open(log)
+    #define PERF_PRINT(os) perf::Counters::get().print(os)
+#else
+    #define PERF_SCOPE(name, elements_count) do {} while (false)
+    #define PERF_OPEN(log) false
+    #define PERF_PRINT(os) do {} while (false)
+#endif
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -1,46 +1,369 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
-#include <SFML/System.hpp>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+/* Hierarchical scoped profiler.
+ *
+ * Zones are opened with PROFILE_SCOPE("name") and closed at the end of the
+ * enclosing scope. Each thread records into its own tree of zones, keyed by
+ * the address of the name literal, so recording takes no lock. Trees are
+ * merged by zone path when a report is requested.
+ *
+ * When tracing is enabled, each thread also keeps its last zones in a ring
+ * buffer, which can be written as Chrome trace-event JSON and loaded in
+ * chrome://tracing or ui.perfetto.dev to inspect individual frames.
+ *
+ * Everything compiles to nothing unless CLOTH_PROFILER is defined, see the
+ * CLOTH_PROFILER CMake option.
+ */
+namespace prof
+{
+
+using Clock = std::chrono::steady_clock;
+
+// Events kept per thread when tracing, the oldest ones are overwritten
+const uint64_t TRACE_CAPACITY_DEFAULT = 1 << 18;
+
+inline uint64_t toNanoseconds(Clock::time_point time)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count());
+}
+
+
+struct Node
+{
+    const char* name = nullptr;
+    uint32_t    parent = 0;
+    uint32_t    first_child = 0;
+    uint32_t    last_child = 0;
+    uint32_t    next_sibling = 0;
+    // Single writer: the thread owning the tree, read by reports
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> total_ns{0};
+
+    void add(uint64_t ns)
+    {
+        calls.store(calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        total_ns.store(total_ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    }
+};
+
+
+// Begin and end of one zone
+struct TraceEvent
+{
+    const char* name;
+    uint64_t    begin_ns;
+    uint64_t    end_ns;
+};
+
+
+struct TraceBuffer
+{
+    std::vector<TraceEvent> events;
+    // Events pushed since the start, the next one goes to count % capacity
+    std::atomic<uint64_t>   count{0};
+
+    void push(const TraceEvent& event)
+    {
+        const uint64_t n = count.load(std::memory_order_relaxed);
+        events[n % events.size()] = event;
+        count.store(n + 1, std::memory_order_release);
+    }
+
+    template<typename TCallback>
+    void forEach(TCallback&& callback) const
+    {
+        const uint64_t n = count.load(std::memory_order_acquire);
+        const uint64_t capacity = events.size();
+        for (uint64_t i(n > capacity ? n - capacity : 0); i < n; ++i) {
+            callback(events[i % capacity]);
+        }
+    }
+};
+
+
+struct ThreadProfile
+{
+    // Node 0 is the root, deque keeps nodes in place when new zones appear
+    std::deque<Node> nodes;
+    uint32_t         current = 0;
+    // Only held to add nodes, so that reports see a consistent tree
+    std::mutex       mutex;
+    // Empty unless tracing
+    TraceBuffer      trace;
+    uint32_t         id;
+    std::string      name;
+
+    explicit
+    ThreadProfile(uint32_t thread_id)
+        : id(thread_id)
+        , name("thread " + std::to_string(thread_id))
+    {
+        nodes.emplace_back();
+    }
+
+    uint32_t getChild(uint32_t parent, const char* name)
+    {
+        uint32_t child = nodes[parent].first_child;
+        while (child && nodes[child].name != name) {
+            child = nodes[child].next_sibling;
+        }
+        if (!child) {
+            const std::lock_guard<std::mutex> lock(mutex);
+            child = static_cast<uint32_t>(nodes.size());
+            Node& node = nodes.emplace_back();
+            node.name = name;
+            node.parent = parent;
+            // Children are kept in order of first call
+            Node& parent_node = nodes[parent];
+            if (parent_node.last_child) {
+                nodes[parent_node.last_child].next_sibling = child;
+            } else {
+                parent_node.first_child = child;
+            }
+            parent_node.last_child = child;
+        }
+        return child;
+    }
+};
 
 
 struct Profiler
 {
-	struct Element
-	{
-		uint32_t start, total;
-		Element()
-			: start(0)
-			, total(0)
-		{}
-
-		void reset()
-		{
-			start = 0;
-			total = 0;
-		}
-
-		float asMilliseconds() const
-		{
-			return total * 0.001f;
-		}
-	};
-
-	sf::Clock clock;
-
-	Profiler()
-	{
-		clock.restart();
-	}
-
-	void start(Element& elem)
-	{
-		elem.start = clock.getElapsedTime().asMicroseconds();
-	}
-
-	void stop(Element& elem)
-	{
-		elem.total += clock.getElapsedTime().asMicroseconds() - elem.start;
-	}
+    // One row per zone path, depth first
+    struct Row
+    {
+        std::string name;
+        uint32_t    depth = 0;
+        uint64_t    calls = 0;
+        uint64_t    total_ns = 0;
+        uint64_t    parent_ns = 0;
+    };
+
+    std::mutex                                  mutex;
+    std::vector<std::unique_ptr<ThreadProfile>> threads;
+    std::atomic<uint64_t>                       frames_count{0};
+    uint64_t                                    trace_capacity = 0;
+    uint64_t                                    epoch_ns = toNanoseconds(Clock::now());
+
+    static Profiler& get()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    static ThreadProfile& getThreadProfile()
+    {
+        thread_local ThreadProfile* profile = get().addThread();
+        return *profile;
+    }
+
+    ThreadProfile* addThread()
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        threads.push_back(std::make_unique<ThreadProfile>(static_cast<uint32_t>(threads.size())));
+        threads.back()->trace.events.resize(trace_capacity);
+        return threads.back().get();
+    }
+
+    static void setThreadName(const std::string& name)
+    {
+        ThreadProfile& thread = getThreadProfile();
+        const std::lock_guard<std::mutex> lock(thread.mutex);
+        thread.name = name;
+    }
+
+    // To be called before other threads record zones
+    void enableTracing(uint64_t capacity = TRACE_CAPACITY_DEFAULT)
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        trace_capacity = capacity;
+        for (const std::unique_ptr<ThreadProfile>& thread : threads) {
+            thread->trace.events.resize(trace_capacity);
+        }
+    }
+
+    // Chrome trace-event JSON, best written between frames when no zone is recorded
+    bool writeTrace(const std::string& path)
+    {
+        std::ofstream file(path);
+        if (!file) {
+            return false;
+        }
+        const std::lock_guard<std::mutex> lock(mutex);
+        file << std::fixed << std::setprecision(3);
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        const auto separator = [&]() -> const char* {
+            const char* s = first ? "" : ",\n";
+            first = false;
+            return s;
+        };
+        for (const std::unique_ptr<ThreadProfile>& thread : threads) {
+            const std::lock_guard<std::mutex> thread_lock(thread->mutex);
+            file << separator() << R"({"ph":"M","name":"thread_name","pid":1,"tid":)" << thread->id
+                 << R"(,"args":{"name":")" << thread->name << "\"}}";
+            if (thread->trace.events.empty()) {
+                continue;
+            }
+            thread->trace.forEach([&](const TraceEvent& event) {
+                // Timestamps in microseconds
+                file << separator() << R"({"ph":"X","pid":1,"tid":)" << thread->id
+                     << R"(,"name":")" << event.name
+                     << R"(","ts":)" << static_cast<double>(event.begin_ns - epoch_ns) * 1e-3
+                     << R"(,"dur":)" << static_cast<double>(event.end_ns - event.begin_ns) * 1e-3 << "}";
+            });
+        }
+        file << "\n]}\n";
+        return static_cast<bool>(file);
+    }
+
+    void nextFrame()
+    {
+        ++frames_count;
+    }
+
+    // Zones with the same path in different threads are merged
+    std::vector<Row> getReport()
+    {
+        std::vector<Row> rows;
+        const std::lock_guard<std::mutex> lock(mutex);
+        for (const std::unique_ptr<ThreadProfile>& thread : threads) {
+            const std::lock_guard<std::mutex> thread_lock(thread->mutex);
+            merge(*thread, 0, rows, rows.size(), 0);
+        }
+        return rows;
+    }
+
+    void print(std::ostream& os)
+    {
+        const std::vector<Row> rows = getReport();
+        const double frames = static_cast<double>(std::max<uint64_t>(1, frames_count));
+        const std::ios::fmtflags flags = os.flags();
+        const std::streamsize precision = os.precision();
+        os << "profile over " << frames_count << " frames:\n"
+           << std::left << std::setw(36) << "zone"
+           << std::right << std::setw(12) << "calls/frame"
+           << std::setw(12) << "ms/frame"
+           << std::setw(12) << "us/call"
+           << std::setw(10) << "% parent" << "\n";
+        for (const Row& row : rows) {
+            const double total_ms = static_cast<double>(row.total_ns) * 1e-6;
+            os << std::left << std::setw(36) << (std::string(2 * row.depth, ' ') + row.name)
+               << std::right << std::fixed << std::setprecision(3)
+               << std::setw(12) << static_cast<double>(row.calls) / frames
+               << std::setw(12) << total_ms / frames
+               << std::setw(12) << 1000.0 * total_ms / static_cast<double>(std::max<uint64_t>(1, row.calls))
+               << std::setw(10) << std::setprecision(1);
+            if (row.parent_ns) {
+                os << 100.0 * static_cast<double>(row.total_ns) / static_cast<double>(row.parent_ns);
+            } else {
+                os << "-";
+            }
+            os << "\n";
+        }
+        os.flags(flags);
+        os.precision(precision);
+        os << std::flush;
+    }
+
+private:
+    // Merges the children of node into the rows following row_parent
+    static void merge(const ThreadProfile& thread, uint32_t node, std::vector<Row>& rows,
+                      uint64_t row_parent, uint32_t depth)
+    {
+        const uint64_t parent_ns = node ? thread.nodes[node].total_ns.load(std::memory_order_relaxed) : 0;
+        for (uint32_t child(thread.nodes[node].first_child); child; child = thread.nodes[child].next_sibling) {
+            const Node& n = thread.nodes[child];
+            uint64_t row = findRow(rows, row_parent, depth, n.name);
+            if (row == rows.size() || rows[row].name != n.name) {
+                rows.insert(rows.begin() + static_cast<int64_t>(row), Row{n.name, depth, 0, 0, 0});
+            }
+            rows[row].calls += n.calls.load(std::memory_order_relaxed);
+            rows[row].total_ns += n.total_ns.load(std::memory_order_relaxed);
+            rows[row].parent_ns += parent_ns;
+            merge(thread, child, rows, row + 1, depth + 1);
+        }
+    }
+
+    // Row of the zone among the siblings starting at first, or where to insert it
+    static uint64_t findRow(const std::vector<Row>& rows, uint64_t first, uint32_t depth, const char* name)
+    {
+        uint64_t row = first;
+        while (row < rows.size() && rows[row].depth >= depth) {
+            if (rows[row].depth == depth && rows[row].name == name) {
+                return row;
+            }
+            ++row;
+        }
+        return row;
+    }
+};
+
+
+struct Scope
+{
+    ThreadProfile&    thread;
+    uint32_t          parent;
+    uint32_t          node;
+    Clock::time_point start;
+
+    explicit
+    Scope(const char* name)
+        : thread(Profiler::getThreadProfile())
+        , parent(thread.current)
+        , node(thread.getChild(parent, name))
+    {
+        thread.current = node;
+        start = Clock::now();
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope()
+    {
+        const Clock::time_point end = Clock::now();
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+        thread.nodes[node].add(static_cast<uint64_t>(elapsed.count()));
+        thread.current = parent;
+        if (!thread.trace.events.empty()) {
+            thread.trace.push({thread.nodes[node].name, toNanoseconds(start), toNanoseconds(end)});
+        }
+    }
 };
 
+}
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+#ifdef CLOTH_PROFILER
+    #define PROFILE_SCOPE(name) const prof::Scope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+    #define PROFILE_FRAME() prof::Profiler::get().nextFrame()
+    #define PROFILE_PRINT(os) prof::Profiler::get().print(os)
+    #define PROFILE_THREAD_NAME(name) prof::Profiler::setThreadName(name)
+    #define PROFILE_ENABLE_TRACING() prof::Profiler::get().enableTracing()
+    #define PROFILE_WRITE_TRACE(path) prof::Profiler::get().writeTrace(path)
+#else
+    #define PROFILE_SCOPE(name) do {} while (false)
+    #define PROFILE_FRAME() do {} while (false)
+    #define PROFILE_PRINT(os) do {} while (false)
+    #define PROFILE_THREAD_NAME(name) do {} while (false)
+    #define PROFILE_ENABLE_TRACING() do {} while (false)
+    #define PROFILE_WRITE_TRACE(path) false
+#endif
+
 /* vim: set ts=4 sts=4 sw=4 et: */
@@ -1,8 +1,15 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 
 
-template<typename T>
+/* Rolling accumulators over the last max_size values.
+ *
+ * TDerived provides get(), resolved at compile time so that reading an
+ * accumulator in a hot loop does not go through a virtual call.
+ */
+template<typename T, typename TDerived>
 struct RAccBase
 {
     uint32_t max_values_count;
@@ -28,16 +35,21 @@ struct RAccBase
         return pop;
     }
 
+    // Number of values in the window
     uint32_t getCount() const
     {
-        return std::min(current_index + 1, max_values_count);
+        return std::min(current_index, max_values_count);
     }
 
-    virtual T get() const = 0;
+    T getMax() const
+    {
+        const uint32_t count = getCount();
+        return count ? *std::max_element(values.begin(), values.begin() + count) : T(0);
+    }
 
     operator T() const
     {
-        return get();
+        return static_cast<const TDerived&>(*this).get();
     }
 
 protected:
@@ -49,44 +61,148 @@ protected:
 
 
 template<typename T>
-struct RMean : public RAccBase<T>
+struct RMean : public RAccBase<T, RMean<T>>
 {
+    using Base = RAccBase<T, RMean<T>>;
     T sum;
 
     RMean(uint32_t max_size=8)
-        : RAccBase<T>(max_size)
+        : Base(max_size)
         , sum(0.0f)
     {
     }
 
     void addValue(T v)
     {
-        sum += v - float(RAccBase<T>::addValueBase(v)) * RAccBase<T>::pop_value;
+        sum += v - float(Base::addValueBase(v)) * Base::pop_value;
     }
 
-    T get() const override
+    T get() const
     {
-        return sum / float(RAccBase<T>::getCount());
+        return sum / float(std::max(1u, Base::getCount()));
     }
 };
 
 
 template<typename T>
-struct RDiff : public RAccBase<T>
+struct RDiff : public RAccBase<T, RDiff<T>>
 {
+    using Base = RAccBase<T, RDiff<T>>;
+
     RDiff(uint32_t max_size = 8)
-        : RAccBase<T>(max_size)
+        : Base(max_size)
+    {
+    }
+
+    void addValue(T v)
+    {
+        Base::addValueBase(v);
+    }
+
+    T get() const
+    {
+        return Base::values[Base::getIndex(-1)] - Base::values[Base::getIndex()];
+    }
+};
+
+
+/* Fixed-width buckets over [0, bucket_width * buckets_count), larger values
+ * share an overflow bucket. Percentiles are exact to one bucket width. */
+template<typename T>
+struct Histogram
+{
+    T bucket_width;
+    std::vector<uint32_t> counts;
+    uint64_t total;
+    T max;
+
+    Histogram(T width, uint32_t buckets_count)
+        : bucket_width(width)
+        , counts(buckets_count + 1, 0)
+        , total(0)
+        , max(0.0f)
+    {
+    }
+
+    uint32_t getBucket(T v) const
+    {
+        const T bucket = std::max(T(0), v / bucket_width);
+        return bucket < T(counts.size() - 1) ? uint32_t(bucket) : uint32_t(counts.size() - 1);
+    }
+
+    void add(T v)
+    {
+        ++counts[getBucket(v)];
+        ++total;
+        max = std::max(max, v);
+    }
+
+    // Only for values previously added, max is not updated
+    void remove(T v)
+    {
+        --counts[getBucket(v)];
+        --total;
+    }
+
+    // Upper bound of the bucket holding the p quantile, p in [0, 1], capped by max
+    T getPercentile(float p) const
+    {
+        if (!total) {
+            return T(0);
+        }
+        const uint64_t rank = std::max<uint64_t>(1, uint64_t(p * float(total) + 0.5f));
+        uint64_t count = 0;
+        for (uint32_t i(0); i < counts.size() - 1; ++i) {
+            count += counts[i];
+            if (count >= rank) {
+                return std::min(bucket_width * T(i + 1), max);
+            }
+        }
+        // Overflow bucket
+        return max;
+    }
+};
+
+
+template<typename T>
+struct RHistogram : public RAccBase<T, RHistogram<T>>
+{
+    using Base = RAccBase<T, RHistogram<T>>;
+    Histogram<T> histogram;
+    T sum;
+
+    RHistogram(uint32_t max_size, T bucket_width, uint32_t buckets_count)
+        : Base(max_size)
+        , histogram(bucket_width, buckets_count)
+        , sum(0.0f)
     {
     }
 
     void addValue(T v)
     {
-        RAccBase<T>::addValueBase(v);
+        if (Base::addValueBase(v)) {
+            histogram.remove(Base::pop_value);
+            sum -= Base::pop_value;
+        }
+        histogram.add(v);
+        sum += v;
+    }
+
+    T getMean() const
+    {
+        return sum / float(std::max(1u, Base::getCount()));
+    }
+
+    T getPercentile(float p) const
+    {
+        // The histogram max is not maintained on removal
+        return std::min(histogram.getPercentile(p), Base::getMax());
     }
 
-    T get() const override
+    // Median
+    T get() const
     {
-        return RAccBase<T>::values[RAccBase<T>::getIndex(-1)] - RAccBase<T>::values[RAccBase<T>::getIndex()];
+        return getPercentile(0.5f);
     }
 };
 
@@ -0,0 +1,167 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "profiler.hpp"
+
+
+namespace tp
+{
+
+struct TaskQueue
+{
+    std::queue<std::function<void()>> tasks;
+    std::mutex                        mutex;
+    std::condition_variable           condition;
+    std::atomic<uint32_t>             remaining_tasks = {0};
+    bool                              running = true;
+
+    template<typename TCallback>
+    void addTask(TCallback&& callback)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push(std::forward<TCallback>(callback));
+            ++remaining_tasks;
+        }
+        condition.notify_one();
+    }
+
+    // Blocks until a task is available, returns false when the queue is stopped
+    bool getTask(std::function<void()>& target)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return !tasks.empty() || !running; });
+        if (tasks.empty()) {
+            return false;
+        }
+        target = std::move(tasks.front());
+        tasks.pop();
+        return true;
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        condition.notify_all();
+    }
+
+    void waitForCompletion() const
+    {
+        while (remaining_tasks > 0) {
+            std::this_thread::yield();
+        }
+    }
+
+    void workDone()
+    {
+        --remaining_tasks;
+    }
+};
+
+
+struct Worker
+{
+    std::thread thread;
+    TaskQueue*  queue = nullptr;
+
+    Worker() = default;
+
+    explicit
+    Worker(TaskQueue& q)
+        : queue(&q)
+    {
+        thread = std::thread([this] { run(); });
+    }
+
+    void run()
+    {
+        PROFILE_THREAD_NAME("worker");
+        std::function<void()> task;
+        while (queue->getTask(task)) {
+            task();
+            queue->workDone();
+        }
+    }
+
+    void join()
+    {
+        thread.join();
+    }
+};
+
+
+struct ThreadPool
+{
+    uint32_t            thread_count = 0;
+    TaskQueue           queue;
+    std::vector<Worker> workers;
+
+    explicit
+    ThreadPool(uint32_t count)
+        : thread_count(count ? count : 1)
+    {
+        workers.reserve(thread_count);
+        for (uint32_t i(thread_count); i--;) {
+            workers.emplace_back(queue);
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool()
+    {
+        queue.stop();
+        for (Worker& worker : workers) {
+            worker.join();
+        }
+    }
+
+    template<typename TCallback>
+    void addTask(TCallback&& callback)
+    {
+        queue.addTask(std::forward<TCallback>(callback));
+    }
+
+    void waitForCompletion() const
+    {
+        queue.waitForCompletion();
+    }
+
+    // Splits [0, element_count) into one batch per thread and waits for all of them
+    template<typename TCallback>
+    void dispatch(uint64_t element_count, TCallback&& callback)
+    {
+        dispatchIndexed(element_count, [&callback](uint32_t, uint64_t start, uint64_t end) {
+            callback(start, end);
+        });
+    }
+
+    // Same as dispatch, the callback also gets the batch index in [0, thread_count)
+    template<typename TCallback>
+    void dispatchIndexed(uint64_t element_count, TCallback&& callback)
+    {
+        const uint64_t batch_size = element_count / thread_count;
+        for (uint32_t i(0); i < thread_count; ++i) {
+            const uint64_t start = batch_size * i;
+            const uint64_t end   = (i == thread_count - 1) ? element_count : start + batch_size;
+            if (start < end) {
+                addTask([i, start, end, &callback] { callback(i, start, end); });
+            }
+        }
+        waitForCompletion();
+    }
+};
+
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */
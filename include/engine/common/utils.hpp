@@ -29,11 +29,4 @@ static std::string toString(T value)
     return sx.str();
 }
 
-
-template<typename T>
-sf::Vector2f toVector2f(sf::Vector2<T> v)
-{
-    return {to<float>(v.x), to<float>(v.y)};
-}
-
 /* vim: set ts=4 sts=4 sw=4 et: */
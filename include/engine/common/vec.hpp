@@ -1,8 +1,12 @@
 #pragma once
 #include <cmath>
+#include <cstdint>
 
 
-struct Vec2
+/* Plain float pair used by the physics, 8 bytes aligned so that a pair loads
+ * and stores as a single 64 bits access. Operations round the same way as
+ * sf::Vector2f, which the renderer converts to. */
+struct alignas(8) Vec2
 {
 	Vec2()
 		: x(0.0f)
@@ -26,8 +30,7 @@ struct Vec2
 
 	Vec2 operator/(float f) const
 	{
-		const float inv = 1.0f / f;
-		return Vec2(x * inv, y * inv);
+		return Vec2(x / f, y / f);
 	}
 
 	Vec2 operator*(float f) const
@@ -45,6 +48,21 @@ struct Vec2
 		return Vec2(-x, -y);
 	}
 
+	Vec2 operator+(const Vec2& other) const
+	{
+		return Vec2(x + other.x, y + other.y);
+	}
+
+	bool operator==(const Vec2& other) const
+	{
+		return x == other.x && y == other.y;
+	}
+
+	bool operator!=(const Vec2& other) const
+	{
+		return !(*this == other);
+	}
+
 	void operator+=(const Vec2& other)
 	{
 		x += other.x;
@@ -63,6 +81,12 @@ struct Vec2
 		y /= f;
 	}
 
+	void operator*=(float f)
+	{
+		x *= f;
+		y *= f;
+	}
+
 	Vec2 plus(const Vec2& other) const
 	{
 		return Vec2(x + other.x, y + other.y);
@@ -123,6 +147,45 @@ struct Vec2
 	float x, y;
 };
 
+inline Vec2 operator*(float f, const Vec2& v)
+{
+	return Vec2(f * v.x, f * v.y);
+}
+
+
+/* Axis aligned rectangle, left and top being the minimum coordinates */
+struct FloatRect
+{
+	float left;
+	float top;
+	float width;
+	float height;
+
+	FloatRect()
+		: left(0.0f)
+		, top(0.0f)
+		, width(0.0f)
+		, height(0.0f)
+	{}
+
+	FloatRect(Vec2 position, Vec2 size)
+		: left(position.x)
+		, top(position.y)
+		, width(size.x)
+		, height(size.y)
+	{}
+
+	// Right and bottom edges are excluded
+	bool contains(Vec2 p) const
+	{
+		const float min_x = std::fmin(left, left + width);
+		const float max_x = std::fmax(left, left + width);
+		const float min_y = std::fmin(top, top + height);
+		const float max_y = std::fmax(top, top + height);
+		return p.x >= min_x && p.x < max_x && p.y >= min_y && p.y < max_y;
+	}
+};
+
 
 struct IVec2
 {
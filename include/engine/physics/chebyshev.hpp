@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "../common/vec.hpp"
+
+struct PhysicSolver;
+
+// Upper bound of the spectral radius estimate, keeps the over-relaxation below 2
+const float CHEBYSHEV_MAX_SPECTRAL_RADIUS = 0.99f;
+// Weight of each sub-step in the observed spectral radius
+const float CHEBYSHEV_OBSERVATION_WEIGHT = 0.2f;
+// The estimate only follows the observed radius once they differ by more
+// than this, so that the over-relaxation does not change at every sub-step
+const float CHEBYSHEV_HYSTERESIS = 0.02f;
+// Applied to the estimate when a sub-step diverges
+const float CHEBYSHEV_FALLBACK_DAMPING = 0.8f;
+// A first sweep correcting this much more than usual means the previous
+// sub-steps diverged
+const double CHEBYSHEV_DIVERGENCE_RATIO = 1.5;
+// Weight of each sub-step in the usual first sweep correction
+const double CHEBYSHEV_TYPICAL_WEIGHT = 0.1;
+
+
+/* Chebyshev semi-iterative acceleration of the links sweeps (Wang 2015).
+ *
+ * After each Gauss-Seidel sweep the positions are extrapolated from the two
+ * previous iterates, x = w (x_sweep - x_previous) + x_previous, with
+ *   w_1 = 1, w_2 = 2 / (2 - r^2), w_k = 4 / (4 - r^2 w_(k-1))
+ * where r is the spectral radius of a sweep. The ratio between the corrections
+ * of the first two sweeps, which are not accelerated, gives a first estimate.
+ * Each accelerated sub-step then observes the radius from the decrease of its
+ * corrections: with an estimate r below the radius p, they shrink by
+ *   q = (p + sqrt(p^2 - r^2)) / (1 + sqrt(1 - r^2))
+ * per sweep, which gives p back. The estimate follows the smoothed observation,
+ * with some hysteresis. A sub-step diverges when its corrections grow past its
+ * first one, or when that first one jumps compared to the previous sub-steps:
+ * it falls back to plain sweeps and the estimate is lowered. An estimate that
+ * diverged within its sub-step also bounds the next ones. The estimate starts
+ * over when the links change.
+ *
+ * The last sweep is not extrapolated, so it takes at least 3 iterations per
+ * sub-step. It only applies to the pbd solver: xpbd multipliers would no
+ * longer match the positions.
+ */
+struct ChebyshevAcceleration
+{
+    bool enabled = false;
+    float spectral_radius = 0.0f;
+    // Number of sub-steps that fell back to plain sweeps
+    uint64_t fallbacks_count = 0;
+
+    // Records the positions before the first sweep of a sub-step
+    void begin(PhysicSolver& solver);
+
+    // Measures the correction of the sweep that just ended and extrapolates
+    void step(PhysicSolver& solver);
+
+private:
+    // Per moving particle, iterates k - 1 and k
+    std::vector<Vec2> previous;
+    std::vector<Vec2> last;
+    uint32_t sweep = 0;
+    float omega = 1.0f;
+    bool accelerating = false;
+    double first_correction = 0.0;
+    double second_correction = 0.0;
+    double typical_correction = 0.0;
+    float observed_radius = 0.0f;
+    // Under the last estimate that diverged
+    float radius_limit = CHEBYSHEV_MAX_SPECTRAL_RADIUS;
+    uint64_t topology_version = ~uint64_t(0);
+
+    void fallBack();
+    // Updates the estimate from the corrections of an accelerated sub-step
+    void observe(double last_correction);
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -1,18 +1,16 @@
 #pragma once
+#include <algorithm>
 #include <cstdint>
 #include "particle.hpp"
-#include "../common/math.hpp"
 
 
+/* Link data read by every solver iteration */
 struct LinkConstraint
 {
     ParticleRef particle_1;
     ParticleRef particle_2;
     float distance = 1.0f;
     float strength = 1.0f;
-    float max_elongation_ratio = 1.5f;
-    bool broken = false;
-    civ::ID id = 0;
 
     LinkConstraint() = default;
 
@@ -20,31 +18,71 @@ struct LinkConstraint
     : particle_1(p_1)
     , particle_2(p_2)
     {
-        distance = MathVec2::length(p_1->position - p_2->position);
+        distance = (p_1->position - p_2->position).getLength();
     }
 
     [[nodiscard]]
     bool isValid() const
     {
-        return particle_2 && particle_1 && !broken;
+        return particle_2 && particle_1;
     }
 
-    void solve()
+    // Returns the current length of the link, before correction. The solver
+    // erases links along with their particles so the references are not checked
+    float solve()
     {
-        if (!isValid()) { return; }
         Particle& p_1 = *particle_1;
         Particle& p_2 = *particle_2;
-        const sf::Vector2f v = p_1.position - p_2.position;
-        const float dist = MathVec2::length(v);
-        if (dist > distance) {
-            broken = dist > distance * max_elongation_ratio;
-            const sf::Vector2f n = v / dist;
+        const Vec2 v = p_1.position - p_2.position;
+        const float dist = v.getLength();
+        // Pinned particles have no inverse mass, the other end takes the whole correction
+        const float w = p_1.inverse_mass + p_2.inverse_mass;
+        if (dist > distance && w > 0.0f) {
+            const Vec2 n = v / dist;
             const float c = distance - dist;
-            const sf::Vector2f p = -(c * strength) / (p_1.mass + p_2.mass) * n;
+            const Vec2 p = (c * strength / w) * n;
             // Apply position correction
-            p_1.move(-p / p_1.mass);
-            p_2.move( p / p_2.mass);
+            p_1.move(p * p_1.inverse_mass);
+            p_2.move(p * -p_2.inverse_mass);
         }
+        return dist;
+    }
+};
+
+
+/* Link data only needed for break detection, bookkeeping and diagnostics */
+struct LinkInfo
+{
+    float max_elongation_ratio = 1.5f;
+    civ::CompactID id = 0;
+    // Length measured by the last solver iteration, before correction
+    float length = 0.0f;
+    // Inverse stiffness for the XPBD and projective dynamics solvers, 0 for
+    // an inextensible link
+    float compliance = 0.0f;
+    // Unit vector from particle 1 to particle 2 when the link was made, used
+    // to tell straight paths regardless of the current shape of the cloth
+    Vec2 rest_direction;
+
+    // To be called when the link is made, from its particles positions
+    void setRestDirection(const LinkConstraint& link)
+    {
+        const Vec2 v = (*link.particle_2).position - (*link.particle_1).position;
+        rest_direction = link.distance > 0.0f ? v / link.distance : Vec2();
+    }
+
+    [[nodiscard]]
+    bool isBroken(const LinkConstraint& link, float length) const
+    {
+        return length > link.distance * max_elongation_ratio;
+    }
+
+    // 0 at rest length or shorter, 1 when the link is about to break
+    [[nodiscard]]
+    float getStrain(const LinkConstraint& link) const
+    {
+        const float elongation = length / link.distance - 1.0f;
+        return std::max(0.0f, elongation / (max_elongation_ratio - 1.0f));
     }
 };
 
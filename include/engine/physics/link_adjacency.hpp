@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "../common/index_vector.hpp"
+
+
+/* Particle to incident links index in CSR form.
+ *
+ * links[offsets[id], offsets[id + 1]) are the handles of the links attached to
+ * particle id. Erasing a link leaves a stale handle behind, which is detected
+ * with the links container isValid; the index only needs to be rebuilt when
+ * links or particles are added.
+ */
+struct LinkAdjacency
+{
+    struct Range
+    {
+        const civ::CompactHandle* first;
+        const civ::CompactHandle* last;
+
+        const civ::CompactHandle* begin() const { return first; }
+        const civ::CompactHandle* end() const { return last; }
+    };
+
+    std::vector<uint32_t>           offsets;
+    std::vector<civ::CompactHandle> links;
+    bool                            dirty = true;
+
+    template<typename TLinks>
+    void build(uint64_t particles_capacity, const TLinks& constraints)
+    {
+        const uint64_t links_count = constraints.size();
+        offsets.assign(particles_capacity + 1, 0);
+        // Count the degree of each particle
+        for (uint64_t i(0); i < links_count; ++i) {
+            const auto& link = constraints.data[i];
+            ++offsets[link.particle_1.getID() + 1];
+            ++offsets[link.particle_2.getID() + 1];
+        }
+        for (uint64_t i(1); i < offsets.size(); ++i) {
+            offsets[i] += offsets[i - 1];
+        }
+        // Fill, using a copy of the offsets as insertion cursors
+        std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+        links.resize(2 * links_count);
+        for (uint64_t i(0); i < links_count; ++i) {
+            const auto& link = constraints.data[i];
+            const civ::CompactHandle handle = constraints.metadata[i];
+            links[cursors[link.particle_1.getID()]++] = handle;
+            links[cursors[link.particle_2.getID()]++] = handle;
+        }
+        dirty = false;
+    }
+
+    Range get(civ::CompactID particle_id) const
+    {
+        const civ::CompactHandle* data = links.data();
+        return {data + offsets[particle_id], data + offsets[particle_id + 1]};
+    }
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
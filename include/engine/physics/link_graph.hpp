@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "../common/index_vector.hpp"
+#include "../common/utils.hpp"
+#include "../common/vec.hpp"
+
+
+/* Undirected weighted graph in CSR form, nodes are dense indices.
+ *
+ * Unlike LinkAdjacency it is a snapshot over data indices, built for one
+ * traversal or one hierarchy level and thrown away when the topology changes.
+ * edges[offsets[node], offsets[node + 1]) are the edges leaving node.
+ */
+struct LinkGraph
+{
+    struct Link
+    {
+        uint32_t a;
+        uint32_t b;
+        float    length;
+        // Unit vector from a to b at rest
+        Vec2     direction;
+    };
+
+    struct Edge
+    {
+        uint32_t node;
+        // Index of the link in the list the graph was built from
+        uint32_t link;
+        float    length;
+        // Rest direction toward node
+        Vec2     direction;
+    };
+
+    std::vector<uint32_t> offsets;
+    std::vector<Edge>     edges;
+
+    void build(uint64_t nodes_count, const std::vector<Link>& links)
+    {
+        offsets.assign(nodes_count + 1, 0);
+        for (const Link& link : links) {
+            ++offsets[link.a + 1];
+            ++offsets[link.b + 1];
+        }
+        for (uint64_t i(1); i < offsets.size(); ++i) {
+            offsets[i] += offsets[i - 1];
+        }
+        // Fill, using a copy of the offsets as insertion cursors
+        std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+        edges.resize(2 * links.size());
+        for (uint64_t k(0); k < links.size(); ++k) {
+            const Link& link = links[k];
+            edges[cursors[link.a]++] = {link.b, to<uint32_t>(k), link.length, link.direction};
+            edges[cursors[link.b]++] = {link.a, to<uint32_t>(k), link.length, -link.direction};
+        }
+    }
+
+    const Edge* begin(uint64_t node) const
+    {
+        return edges.data() + offsets[node];
+    }
+
+    const Edge* end(uint64_t node) const
+    {
+        return edges.data() + offsets[node + 1];
+    }
+
+    // The solver links between particle data indices, with their rest length
+    // and direction, in the links data order
+    template<typename TParticles, typename TLinks>
+    static std::vector<Link> getLinks(const TParticles& objects, const TLinks& constraints)
+    {
+        std::vector<Link> links(constraints.size());
+        for (uint64_t k(0); k < links.size(); ++k) {
+            const auto& link = constraints.data[k];
+            links[k] = {to<uint32_t>(objects.getDataID(link.particle_1.getID())),
+                        to<uint32_t>(objects.getDataID(link.particle_2.getID())),
+                        link.distance,
+                        constraints.cold[k].rest_direction};
+        }
+        return links;
+    }
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "../common/index_vector.hpp"
+#include "constraints.hpp"
+#include "link_adjacency.hpp"
+
+
+/* Links of one kind besides the structural ones, shear or bend.
+ *
+ * Same hot and cold streams as PhysicSolver::constraints, with their own
+ * broken links list and incident links index, so that each kind is solved by
+ * its own pass over contiguous data and the structural pass is left as is.
+ * The strength of each link is its stiffness, as a share of the correction.
+ */
+struct LinkGroup
+{
+    civ::CompactSplitVector<LinkConstraint, LinkInfo> links;
+    std::vector<civ::CompactID> broken_links;
+    LinkAdjacency adjacency;
+
+    civ::CompactID add(LinkConstraint link, float max_elongation_ratio)
+    {
+        const civ::CompactID link_id = links.push_back(link);
+        LinkInfo& info = links.getCold(link_id);
+        info.id = link_id;
+        info.max_elongation_ratio = max_elongation_ratio;
+        info.setRestDirection(link);
+        adjacency.dirty = true;
+        return link_id;
+    }
+
+    // Bulk version of add, see PhysicSolver::addLinks
+    civ::CompactID allocate(uint64_t count)
+    {
+        adjacency.dirty = true;
+        return links.allocate(count);
+    }
+
+    // Returns true if any link was erased
+    bool eraseBrokenLinks()
+    {
+        for (const civ::CompactID id : broken_links) {
+            links.erase(id);
+        }
+        const bool erased = !broken_links.empty();
+        broken_links.clear();
+        return erased;
+    }
+
+    // Erases the links attached to a particle, before the particle itself
+    void eraseIncidentLinks(uint64_t particles_capacity, civ::CompactID particle_id)
+    {
+        if (adjacency.dirty) {
+            adjacency.build(particles_capacity, links);
+        }
+        for (const civ::CompactHandle& link : adjacency.get(particle_id)) {
+            if (links.isValid(link)) {
+                links.erase(link.rid);
+            }
+        }
+    }
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
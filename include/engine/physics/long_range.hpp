@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "../common/index_vector.hpp"
+
+struct PhysicSolver;
+
+
+/* Long range attachments (Kim et al. 2012).
+ *
+ * Each moving particle is attached to its nearest pinned particle, by graph
+ * distance along the links, and can not get farther from it than that
+ * distance. It is a one sided constraint: it does nothing until the cloth
+ * stretches, then pulls the particles back at once instead of waiting for the
+ * tension to go down the links one Gauss-Seidel pass at a time.
+ *
+ * The attachments are found with a multi-source Dijkstra from the pinned
+ * particles, and kept until the topology changes. Erased links only trigger a
+ * new search when one of them was on a shortest path, which is how tearing
+ * disconnects a region. Added links can only shorten the paths, the current
+ * distances stay valid bounds until the next search.
+ */
+struct LongRangeAttachments
+{
+    static constexpr uint32_t NO_ANCHOR = 0xFFFFFFFF;
+
+    bool enabled = false;
+    // Number of searches so far, to measure how often tearing triggers one
+    uint64_t searches_count = 0;
+
+    // Brings the particles back within reach of their anchor, searching the
+    // anchors again first if needed
+    void solve(PhysicSolver& solver);
+
+    // Searches the anchors again if the particles or a shortest path changed
+    void update(PhysicSolver& solver);
+
+    void search(PhysicSolver& solver);
+
+private:
+    uint64_t particles_version = ~uint64_t(0);
+    uint64_t topology_version = ~uint64_t(0);
+    // Per moving particle, in data order after the pinned range: data index of
+    // the nearest pinned particle or NO_ANCHOR, graph distance to it and link
+    // to the previous particle of the path
+    std::vector<uint32_t>           anchors;
+    std::vector<float>              distances;
+    std::vector<civ::CompactHandle> path_links;
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
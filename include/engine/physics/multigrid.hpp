@@ -0,0 +1,77 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "../common/index_vector.hpp"
+#include "../common/vec.hpp"
+#include "link_graph.hpp"
+
+struct PhysicSolver;
+
+
+/* Coarse to fine passes over decimated copies of the links graph, in the
+ * manner of hierarchical position based dynamics (Mueller 2008).
+ *
+ * Each level keeps a maximal independent set of the finer one, so that every
+ * dropped particle has a kept neighbour. Kept particles two links apart along
+ * a path that is straight at rest are linked, with the sum of the rest
+ * lengths, which on a grid gives links twice as long at each level. A pass
+ * solves the coarsest level first, then moves each dropped particle of the
+ * level below by the mean displacement of its kept neighbours, down to the
+ * full cloth. Tension then spans the cloth in a number of passes that grows
+ * with the logarithm of its size.
+ *
+ * The levels only depend on the rest geometry and are built again when the
+ * particles change. Erased links disable the coarse links and parents relying
+ * on them instead, level by level, so tearing does not trigger a build. Added
+ * links are left to the fine passes until the next build.
+ */
+struct Multigrid
+{
+    struct Level
+    {
+        // Data indices of the kept particles
+        std::vector<uint32_t> nodes;
+        // Between data indices, only resisting stretching like the fine links
+        std::vector<LinkGraph::Link> links;
+        // Per link, the two links of the finer level it spans, and whether
+        // they all still exist
+        std::vector<std::array<uint32_t, 2>> link_sources;
+        std::vector<uint8_t> alive;
+        // Data indices of the particles of the finer level dropped by this one,
+        // with their neighbours among nodes, as indices into nodes, and the
+        // finer level links to them
+        std::vector<uint32_t> children;
+        std::vector<uint32_t> parent_offsets;
+        std::vector<uint32_t> parents;
+        std::vector<uint32_t> parent_links;
+        // Position of the nodes before the pass, then their displacement
+        std::vector<Vec2> displacements;
+    };
+
+    // Number of coarse levels, 0 disables the passes
+    uint32_t levels = 0;
+    std::vector<Level> hierarchy;
+    // Number of builds so far, tearing alone should not trigger any
+    uint64_t builds_count = 0;
+
+    // One coarse to fine pass, updating the levels first if needed
+    void solve(PhysicSolver& solver);
+
+    // Builds the levels again if the particles changed, otherwise disables
+    // what relies on erased links
+    void update(PhysicSolver& solver);
+
+    void build(PhysicSolver& solver);
+
+private:
+    uint64_t particles_version = ~uint64_t(0);
+    uint64_t topology_version = ~uint64_t(0);
+    uint32_t built_levels = 0;
+    // Structural links the first level was built from, the sources of its
+    // links index them, and whether they still exist
+    std::vector<civ::CompactHandle> fine_links;
+    std::vector<uint8_t> fine_alive;
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
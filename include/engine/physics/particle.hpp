@@ -1,38 +1,46 @@
 #pragma once
-#include <SFML/System/Vector2.hpp>
+#include "../common/color.hpp"
 #include "../common/index_vector.hpp"
+#include "../common/vec.hpp"
 
 
 struct Particle
 {
-    civ::ID id = 0;
+    civ::CompactID id = 0;
     float mass = 1.0f;
-    sf::Vector2f position;
-    sf::Vector2f position_old;
-    sf::Vector2f velocity;
-    sf::Vector2f forces;
-    sf::Color color = sf::Color::White;
-    bool moving = true;
+    // Zero for pinned particles, see PhysicSolver::pin
+    float inverse_mass = 1.0f;
+    Vec2 position;
+    Vec2 position_old;
+    Vec2 velocity;
+    Vec2 forces;
+    Color color = Color::white();
 
     Particle() = default;
 
     explicit
-    Particle(sf::Vector2f pos)
+    Particle(Vec2 pos)
     : position(pos)
     , position_old(pos)
     {}
 
-    Particle(float mass, sf::Vector2f pos)
+    Particle(float mass, Vec2 pos)
     : mass(mass)
+    , inverse_mass(1.0f / mass)
     , position(pos)
     , position_old(pos)
     {}
 
+    [[nodiscard]]
+    bool isPinned() const
+    {
+        return inverse_mass == 0.0f;
+    }
+
     void update(float dt)
     {
-        if (!moving) return;
         position_old = position;
-        velocity += (forces / mass) * dt;
+        velocity += forces * (inverse_mass * dt);
         position += velocity * dt;
     }
 
@@ -42,13 +50,12 @@ struct Particle
         forces = {};
     }
 
-    void move(sf::Vector2f v)
+    void move(Vec2 v)
     {
-        if (!moving) return;
         position += v;
     }
 };
 
-using ParticleRef = civ::Ref<Particle>;
+using ParticleRef = civ::CompactRef<Particle>;
 
 /* vim: set ts=4 sts=4 sw=4 et: */
@@ -1,112 +1,283 @@
 #pragma once
-#include <functional>
-#include <SFML/System/Vector2.hpp>
+#include <algorithm>
+#include <cmath>
+#include <memory>
 #include "engine/common/index_vector.hpp"
+#include "engine/common/perf_counters.hpp"
+#include "engine/common/profiler.hpp"
+#include "engine/common/thread_pool.hpp"
 #include "engine/common/utils.hpp"
+#include "chebyshev.hpp"
 #include "constraints.hpp"
+#include "link_adjacency.hpp"
+#include "link_group.hpp"
+#include "long_range.hpp"
+#include "multigrid.hpp"
+#include "solver_kernel.hpp"
 
 const float GRAVITY_X_DEFAULT = 0.0f;
 const float GRAVITY_Y_DEFAULT = 1500.0f;
 const float FRICTION_DEFAULT = 0.5f;
+const uint32_t SUB_STEPS_DEFAULT = 16;
+const uint32_t SOLVER_ITERATIONS_DEFAULT = 1;
+const float WARM_START_DEFAULT = 0.0f;
+// Under this many particles the passes are not worth splitting between threads
+const uint64_t PARALLEL_MIN_PARTICLES = 4096;
 
 struct PhysicSolver
 {
-    CIVector<Particle>       objects;
-    CIVector<LinkConstraint> constraints;
+    // Optional storage shared by all the solver arrays, declared first to outlive them
+    std::unique_ptr<civ::Arena> arena;
+    civ::CompactVector<Particle> objects;
+    // Pinned particles come first, objects.data[0, pinned_count), so that the
+    // particle passes only iterate over the moving ones
+    uint64_t pinned_count;
+    // Links are split in a hot stream (LinkConstraint) iterated by the solver
+    // and a parallel cold stream (LinkInfo) used for breakage and bookkeeping
+    civ::CompactSplitVector<LinkConstraint, LinkInfo> constraints;
+    std::vector<civ::CompactID> broken_links;
+    // Particle to incident links, links never outlive their particles
+    LinkAdjacency adjacency;
+    // Diagonal and skip-one links, each kind solved by its own pass after the
+    // structural links. Only the iterative solvers use them
+    LinkGroup shear_links;
+    LinkGroup bend_links;
     // Simulator iterations count
     uint32_t solver_iterations;
     uint32_t sub_steps;
     // Physics parameters
-    sf::Vector2f gravity;
+    Vec2 gravity;
     float friction_coef;
+    // Share of the previous sub-step XPBD multipliers used as initial guess,
+    // the positions do not carry their correction so it is off by default
+    float warm_start;
+    // Incremented each time particles or links are added, removed or reordered
+    uint64_t topology_version;
+    // Incremented each time the particles data indices change: particles
+    // added, erased, pinned or unpinned
+    uint64_t particles_version;
+    // Upper bound of the distance traveled by any particle during the last update
+    float motion;
+    // Optional, shares the particle passes between threads. Links are still
+    // solved serially since Gauss-Seidel updates depend on the previous links
+    tp::ThreadPool* thread_pool;
+    std::vector<float> batch_max_velocity2;
+    // Optional coarse corrections run before the links passes, for the
+    // iterative solvers
+    Multigrid multigrid;
+    LongRangeAttachments long_range;
+    // Optional extrapolation between the links sweeps, pbd only
+    ChebyshevAcceleration chebyshev;
+    // Specialized passes, selected from kernel_config by updateKernel
+    SolverKernelConfig kernel_config;
+    std::unique_ptr<SolverKernel> kernel;
 
     PhysicSolver(float gx=GRAVITY_X_DEFAULT,
                  float gy=GRAVITY_Y_DEFAULT,
                  float fc=FRICTION_DEFAULT)
-        : solver_iterations(1)
-        , sub_steps(16)
+        : pinned_count(0)
+        , solver_iterations(SOLVER_ITERATIONS_DEFAULT)
+        , sub_steps(SUB_STEPS_DEFAULT)
         , gravity(gx, gy)
         , friction_coef(fc)
-    {}
-
-    void update(float dt)
-    {
-        const float sub_step_dt = dt / to<float>(sub_steps);
-        removeBrokenLinks();
-        for (uint32_t i(sub_steps); i--;) {
-            applyGravity();
-            applyAirFriction();
-            updatePositions(sub_step_dt);
-            solveConstraints();
-            updateDerivatives(sub_step_dt);
-        }
+        , warm_start(WARM_START_DEFAULT)
+        , topology_version(0)
+        , particles_version(0)
+        , motion(0.0f)
+        , thread_pool(nullptr)
+    {
+        updateKernel();
     }
 
-    void applyGravity()
+    // Advances the simulation by dt, in sub_steps sub-steps
+    void update(float dt);
+
+    // Selects the kernel matching kernel_config, the friction coefficient and
+    // the thread pool. Needed after changing any of them
+    void updateKernel();
+
+    void setThreadPool(tp::ThreadPool* pool)
     {
-        for (Particle& p : objects) {
-            p.forces += gravity * p.mass;
-        }
+        thread_pool = pool;
+        updateKernel();
     }
 
-    void applyAirFriction()
+    // Calls callback(particle) for every particle, inlined. Runs in parallel
+    // when a thread pool is set, the callback must then only touch its particle
+    template<typename TCallback>
+    void map(TCallback&& callback)
     {
-        for (Particle& p : objects) {
-            p.forces -= p.velocity * friction_coef;
+        if (thread_pool && objects.size() >= PARALLEL_MIN_PARTICLES) {
+            thread_pool->dispatch(objects.size(), [&](uint64_t start, uint64_t end) {
+                for (uint64_t i(start); i < end; ++i) {
+                    callback(objects.data[i]);
+                }
+            });
+        } else {
+            for (Particle& p : objects) {
+                callback(p);
+            }
         }
     }
 
-    void updatePositions(float dt)
+    // Calls callback(start, end) over ranges of [0, count), split between the
+    // threads when a thread pool is set and count is large enough
+    template<typename TCallback>
+    void parallelFor(uint64_t count, TCallback&& callback)
     {
-        for (Particle& p : objects) {
-            p.update(dt);
+        if (thread_pool && count >= PARALLEL_MIN_PARTICLES) {
+            thread_pool->dispatch(count, callback);
+        } else {
+            callback(0, count);
         }
     }
 
+    // The passes of a sub-step, see SolverKernel
+    void integrate(float dt)
+    {
+        kernel->integrate(*this, dt);
+    }
+
+    void solveConstraints(float dt)
+    {
+        kernel->solveConstraints(*this, dt);
+    }
+
     void updateDerivatives(float dt)
     {
-        for (Particle& p : objects) {
-            p.updateDerivatives(dt);
-        }
+        kernel->updateDerivatives(*this, dt);
     }
 
-    void solveConstraints()
+    // Moves a particle between the pinned and moving ranges, in O(1). Data
+    // indices change, IDs and references do not
+    void pin(civ::CompactID particle_id);
+    void unpin(civ::CompactID particle_id);
+
+    [[nodiscard]]
+    bool isPinned(civ::CompactID particle_id) const
     {
-        for (uint32_t i(solver_iterations); i--;) {
-            for (LinkConstraint &l: constraints) {
-                l.solve();
-            }
-        }
+        return objects.getDataID(particle_id) < pinned_count;
     }
 
-    void removeBrokenLinks()
+    [[nodiscard]]
+    bool hasMotion(float threshold = 0.0f) const
     {
-        for (LinkConstraint& l : constraints) {
-            if (!l.isValid()) {
-                constraints.erase(l.id);
-            }
+        return motion > threshold;
+    }
+
+    // Erases the links collected in broken_links by the constraints pass
+    void eraseBrokenLinks();
+
+    // Removes a particle along with its incident links, in O(degree)
+    void eraseParticle(civ::CompactID particle_id);
+
+    // Handles of the links attached to a particle, some may have been erased
+    LinkAdjacency::Range getIncidentLinks(civ::CompactID particle_id)
+    {
+        if (adjacency.dirty) {
+            adjacency.build(objects.data.size(), constraints);
         }
+        return adjacency.get(particle_id);
     }
 
-    civ::ID addParticle(sf::Vector2f position)
+    civ::CompactID addParticle(Vec2 position)
     {
-        const civ::ID particle_id = objects.emplace_back(position);
+        const civ::CompactID particle_id = objects.emplace_back(position);
         objects[particle_id].id = particle_id;
+        markParticlesAdded();
+        ++particles_version;
         return particle_id;
     }
 
-    void addLink(civ::ID particle_1, civ::ID particle_2, float max_elongation_ratio = 1.5f)
+    void addLink(civ::CompactID particle_1, civ::CompactID particle_2, float max_elongation_ratio = 1.5f)
+    {
+        const civ::CompactID link_id = constraints.emplace_back(objects.getRef(particle_1), objects.getRef(particle_2));
+        LinkInfo& info = constraints.getCold(link_id);
+        info.id = link_id;
+        info.max_elongation_ratio = max_elongation_ratio;
+        info.setRestDirection(constraints[link_id]);
+        adjacency.dirty = true;
+        ++topology_version;
+    }
+
+    // Shear or bend link, with a stiffness in [0, 1]
+    void addLink(LinkGroup& group, civ::CompactID particle_1, civ::CompactID particle_2,
+                 float stiffness, float max_elongation_ratio = 1.5f)
     {
-        const civ::ID link_id = constraints.emplace_back(objects.getRef(particle_1), objects.getRef(particle_2));
-        constraints[link_id].id = link_id;
-        constraints[link_id].max_elongation_ratio = max_elongation_ratio;
+        LinkConstraint link(objects.getRef(particle_1), objects.getRef(particle_2));
+        link.strength = stiffness;
+        group.add(link, max_elongation_ratio);
+        ++topology_version;
     }
 
-    void map(const std::function<void(Particle&)>& callback)
+    // XPBD inverse stiffness of every link, 0 for inextensible links
+    void setCompliance(float compliance)
     {
-        for (Particle& p : objects) {
-            callback(p);
+        for (uint64_t k(0); k < constraints.size(); ++k) {
+            constraints.cold[k].compliance = compliance;
         }
+        // The XPBD multipliers and the projective dynamics system are built
+        // from the compliances
+        ++topology_version;
+    }
+
+    // Bytes needed to store the given amount of objects, including ID tables.
+    // links_count covers the links of every kind
+    static uint64_t getStorageSize(uint64_t particles_count, uint64_t links_count)
+    {
+        const uint64_t slot_size = sizeof(civ::CompactID) + sizeof(civ::CompactSlotMetadata);
+        return particles_count * (sizeof(Particle) + slot_size)
+             + links_count * (sizeof(LinkConstraint) + sizeof(LinkInfo) + slot_size)
+             + 15 * civ::ARENA_ALIGNMENT;
+    }
+
+    // Moves all the solver arrays into a single aligned arena
+    void useArena(uint64_t size, bool huge_pages = false)
+    {
+        auto new_arena = std::make_unique<civ::Arena>(size, huge_pages);
+        objects.setArena(new_arena.get());
+        constraints.setArena(new_arena.get());
+        shear_links.links.setArena(new_arena.get());
+        bend_links.links.setArena(new_arena.get());
+        arena = std::move(new_arena);
+    }
+
+    void reserve(uint64_t particles_count, uint64_t links_count)
+    {
+        objects.reserve(particles_count);
+        constraints.reserve(links_count);
+    }
+
+    // Bulk versions of addParticle and addLink: the returned ID is the first of
+    // count contiguous IDs whose data the caller is expected to fill
+    civ::CompactID addParticles(uint64_t count)
+    {
+        markParticlesAdded();
+        ++particles_version;
+        return objects.allocate(count);
+    }
+
+    civ::CompactID addLinks(uint64_t count)
+    {
+        adjacency.dirty = true;
+        ++topology_version;
+        return constraints.allocate(count);
+    }
+
+    civ::CompactID addLinks(LinkGroup& group, uint64_t count)
+    {
+        ++topology_version;
+        return group.allocate(count);
+    }
+
+private:
+    // Incident links indexes are sized by the particles capacity
+    void markParticlesAdded()
+    {
+        adjacency.dirty = true;
+        shear_links.adjacency.dirty = true;
+        bend_links.adjacency.dirty = true;
+        ++topology_version;
     }
 };
 
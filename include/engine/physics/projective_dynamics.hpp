@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "../common/vec.hpp"
+
+struct PhysicSolver;
+
+// Weight of the links without compliance, nearly inextensible
+const float PD_INEXTENSIBLE_STIFFNESS = 1.0e7f;
+
+
+/* Projective dynamics implicit solver (Bouaziz et al. 2014).
+ *
+ * Each sub-step minimizes the inertia of the moving particles plus the
+ * distance energy of the links. A local step projects every link on its rest
+ * length, in parallel, then a global step solves the sparse linear system
+ *   (M / dt^2 + sum w A^T A) x = M / dt^2 s + sum w A^T p
+ * where s are the positions predicted by the integrator. The matrix only
+ * depends on the topology, the masses and dt, so it is factorized once and
+ * factorized again when links or particles are added, removed or pinned.
+ * Pinned particles are not unknowns, their links move to the right hand side.
+ * Links only resist stretching: a slack link projects on its current length.
+ */
+struct ProjectiveDynamics
+{
+    // A link attached to a moving particle, for the right hand side gather
+    struct Incidence
+    {
+        uint32_t link;
+        // Data index of the other particle if it is pinned, NO_PARTICLE otherwise
+        uint32_t pinned;
+        // +1 when the particle is the first end of the link, -1 otherwise
+        float sign;
+    };
+
+    static constexpr uint32_t NO_PARTICLE = 0xFFFFFFFF;
+
+    ProjectiveDynamics();
+    ~ProjectiveDynamics();
+
+    // Local and global steps, solver_iterations times, starting from the
+    // predicted positions. Factorizes first if needed
+    void solve(PhysicSolver& solver, float dt);
+
+    [[nodiscard]]
+    bool needsFactorization(const PhysicSolver& solver, float dt) const;
+
+    void factorize(PhysicSolver& solver, float dt);
+
+    // Number of factorizations so far, to measure how often tearing triggers one
+    uint64_t factorizations_count;
+
+private:
+    struct System;
+
+    uint64_t topology_version;
+    float    factorized_dt;
+    // Per link, in the solver data order
+    std::vector<float> weights;
+    std::vector<Vec2>  weighted_projections;
+    // Per moving particle: predicted positions and links, in CSR form
+    std::vector<Vec2>      predictions;
+    std::vector<uint32_t>  incidence_offsets;
+    std::vector<Incidence> incidences;
+    std::unique_ptr<System> system;
+
+    void project(PhysicSolver& solver);
+    void solveGlobal(PhysicSolver& solver, float dt);
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
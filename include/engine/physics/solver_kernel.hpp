@@ -0,0 +1,80 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+struct PhysicSolver;
+struct Wind;
+
+
+enum class Integrator
+{
+    // Velocity from the forces, then position from the velocity
+    SemiImplicitEuler = 0,
+    // Position from the previous displacement and the forces
+    Verlet
+};
+
+const char* getIntegratorName(Integrator integrator);
+
+// Returns false if the name is unknown
+bool parseIntegrator(const std::string& name, Integrator& integrator);
+
+
+enum class ConstraintSolver
+{
+    // Position based, the stiffness depends on the sub-steps and iterations
+    PBD = 0,
+    // Extended position based, stiffness given by the links compliance
+    XPBD,
+    // Implicit, a global sparse solve per iteration, see ProjectiveDynamics
+    ProjectiveDynamics
+};
+
+const char* getConstraintSolverName(ConstraintSolver constraint_solver);
+
+// Returns false if the name is unknown
+bool parseConstraintSolver(const std::string& name, ConstraintSolver& constraint_solver);
+
+
+/* Selects the specialized kernel, see makeSolverKernel. friction and threaded
+ * are derived from the solver by PhysicSolver::updateKernel */
+struct SolverKernelConfig
+{
+    Integrator integrator = Integrator::SemiImplicitEuler;
+    ConstraintSolver constraint_solver = ConstraintSolver::PBD;
+    bool friction = true;
+    bool wind = true;
+    bool threaded = false;
+};
+
+
+/* The solver passes, compiled once per combination of policies (integrator,
+ * friction, constraint kernel, wind and threading) in solver_policies.hpp so
+ * that each loop is specialized. The virtual call happens once per pass, not
+ * per particle or link. */
+struct SolverKernel
+{
+    virtual ~SolverKernel() = default;
+
+    virtual const std::string& getName() const = 0;
+
+    // Sub-steps loop, same as calling the passes below in order
+    virtual void update(PhysicSolver& solver, float dt) = 0;
+
+    // Gravity, friction and integration, fused in a single pass
+    virtual void integrate(PhysicSolver& solver, float dt) = 0;
+
+    virtual void solveConstraints(PhysicSolver& solver, float dt) = 0;
+
+    virtual void updateDerivatives(PhysicSolver& solver, float dt) = 0;
+
+    // Adds the winds forces, for the next update
+    virtual void applyWind(PhysicSolver& solver, const std::vector<Wind>& winds, float dt) = 0;
+};
+
+
+// Returns the kernel instantiated for this configuration
+std::unique_ptr<SolverKernel> makeSolverKernel(const SolverKernelConfig& config);
+
+/* vim: set ts=4 sts=4 sw=4 et: */
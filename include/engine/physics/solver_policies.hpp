@@ -0,0 +1,469 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "physics.hpp"
+#include "projective_dynamics.hpp"
+#include "solver_kernel.hpp"
+#include "wind.hpp"
+
+
+/* Policies of the specialized solver kernels.
+ *
+ * Each policy is a stateless struct of static inline functions, resolved at
+ * compile time. The particle passes only run over the moving particles, after
+ * the pinned range, and the constraints weight their corrections by inverse
+ * masses, so that no loop branches on pinning.
+ */
+
+// Integrators
+
+struct SemiImplicitEuler
+{
+    static constexpr const char* NAME = "euler";
+
+    static void integrate(Particle& p, float dt)
+    {
+        p.update(dt);
+    }
+};
+
+struct Verlet
+{
+    static constexpr const char* NAME = "verlet";
+
+    static void integrate(Particle& p, float dt)
+    {
+        const Vec2 position = p.position;
+        p.position += (p.position - p.position_old) + p.forces * (dt * dt * p.inverse_mass);
+        p.position_old = position;
+    }
+};
+
+// Friction models
+
+struct AirFriction
+{
+    static constexpr const char* NAME = "friction";
+
+    static void apply(Particle& p, float coef)
+    {
+        p.forces -= p.velocity * coef;
+    }
+};
+
+struct NoFriction
+{
+    static constexpr const char* NAME = "frictionless";
+
+    static void apply(Particle&, float)
+    {}
+};
+
+// Constraint kernels
+
+/* Per link state of the XPBD kernel, in a parallel array of the links data
+ * so that the other kernels do not stream it */
+struct XPBDMultiplier
+{
+    float compliance = 0.0f;
+    float lambda = 0.0f;
+};
+
+struct DistanceConstraint
+{
+    static constexpr const char* NAME = "pbd";
+    static constexpr bool MULTIPLIERS = false;
+    static constexpr bool ACCELERATED = true;
+
+    // Returns the length before correction
+    static float solve(LinkConstraint& link, XPBDMultiplier&, float)
+    {
+        return link.solve();
+    }
+};
+
+/* XPBD distance constraint, C = length - rest length. The time scaled
+ * compliance makes the stiffness independent of the iterations count, and
+ * lambda accumulates the correction of the sub-step. Links only resist
+ * stretching, so lambda is kept negative or zero. The accumulation can start
+ * from a share of the previous sub-step multiplier, see warm_start. */
+struct XPBDConstraint
+{
+    static constexpr const char* NAME = "xpbd";
+    static constexpr bool MULTIPLIERS = true;
+    // Extrapolated positions would no longer match the multipliers
+    static constexpr bool ACCELERATED = false;
+
+    // inv_dt2 is the inverse of the squared sub-step duration
+    static float solve(LinkConstraint& link, XPBDMultiplier& multiplier, float inv_dt2)
+    {
+        Particle& p_1 = *link.particle_1;
+        Particle& p_2 = *link.particle_2;
+        const Vec2 v = p_1.position - p_2.position;
+        const float dist = v.getLength();
+        const float alpha = multiplier.compliance * inv_dt2;
+        const float denominator = p_1.inverse_mass + p_2.inverse_mass + alpha;
+        if ((dist > link.distance || multiplier.lambda < 0.0f) && dist > 0.0f && denominator > 0.0f) {
+            const float c = dist - link.distance;
+            const float lambda = std::min(0.0f, multiplier.lambda - (c + alpha * multiplier.lambda) / denominator);
+            const Vec2 p = v * ((lambda - multiplier.lambda) / dist);
+            multiplier.lambda = lambda;
+            p_1.position += p * p_1.inverse_mass;
+            p_2.position -= p * p_2.inverse_mass;
+        }
+        return dist;
+    }
+};
+
+/* Shear and bend links, see LinkGroup. They reuse the structural correction
+ * in the directions they resist: diagonals keep the cells square both ways,
+ * skip-one links only resist folding, which shortens them. The directions are
+ * compile time constants, so each kind gets its own branch-free loop. */
+template<bool STRETCH, bool COMPRESSION>
+struct LinkKind
+{
+    // Returns the length before correction
+    static float solve(LinkConstraint& link)
+    {
+        Particle& p_1 = *link.particle_1;
+        Particle& p_2 = *link.particle_2;
+        const Vec2 v = p_1.position - p_2.position;
+        const float dist = v.getLength();
+        const float w = p_1.inverse_mass + p_2.inverse_mass;
+        const bool active = (STRETCH && dist > link.distance) || (COMPRESSION && dist < link.distance);
+        if (active && dist > 0.0f && w > 0.0f) {
+            const Vec2 p = v * ((link.distance - dist) * link.strength / (dist * w));
+            p_1.move(p * p_1.inverse_mass);
+            p_2.move(p * -p_2.inverse_mass);
+        }
+        return dist;
+    }
+};
+
+using ShearLink = LinkKind<true, true>;
+using BendLink = LinkKind<false, true>;
+
+// Tag of the projective dynamics solver, see ProjectiveDynamicsKernel
+struct ProjectiveDynamicsConstraint
+{
+    static constexpr const char* NAME = "pd";
+};
+
+// Wind models
+
+struct RectWind
+{
+    static constexpr const char* NAME = "wind";
+
+    // Bounds of a wind rectangle, normalized once per frame
+    struct Area
+    {
+        Vec2 min;
+        Vec2 max;
+        Vec2 force;
+    };
+
+    // Forces are scaled by the frame duration, they only act on the first sub-step
+    static void prepare(std::vector<Area>& areas, const std::vector<Wind>& winds, float dt)
+    {
+        areas.clear();
+        for (const Wind& w : winds) {
+            const FloatRect& r = w.rect;
+            areas.push_back({{std::min(r.left, r.left + r.width), std::min(r.top, r.top + r.height)},
+                             {std::max(r.left, r.left + r.width), std::max(r.top, r.top + r.height)},
+                             1.0f * w.force / dt});
+        }
+    }
+
+    // Same bounds as FloatRect::contains
+    static void apply(Particle& p, const Area& area)
+    {
+        const Vec2 pos = p.position;
+        if (pos.x >= area.min.x && pos.x < area.max.x && pos.y >= area.min.y && pos.y < area.max.y) {
+            p.forces += area.force;
+        }
+    }
+};
+
+struct NoWind
+{
+    static constexpr const char* NAME = "windless";
+
+    using Area = RectWind::Area;
+
+    static void prepare(std::vector<Area>& areas, const std::vector<Wind>&, float)
+    {
+        areas.clear();
+    }
+
+    static void apply(Particle&, const Area&)
+    {}
+};
+
+// Threading backends
+
+struct SerialExecution
+{
+    static constexpr const char* NAME = "serial";
+
+    // Calls callback(particle) for the moving particles
+    template<typename TCallback>
+    static void forEach(PhysicSolver& solver, TCallback&& callback)
+    {
+        Particle* const particles = solver.objects.data.data();
+        const uint64_t count = solver.objects.size();
+        for (uint64_t i(solver.pinned_count); i < count; ++i) {
+            callback(particles[i]);
+        }
+    }
+
+    // callback(start, end) returns the maximum over a range of moving particles
+    template<typename TCallback>
+    static float reduceMax(PhysicSolver& solver, TCallback&& callback)
+    {
+        return callback(solver.pinned_count, solver.objects.size());
+    }
+};
+
+struct PoolExecution
+{
+    static constexpr const char* NAME = "pool";
+
+    static bool isParallel(const PhysicSolver& solver)
+    {
+        return solver.thread_pool && solver.objects.size() - solver.pinned_count >= PARALLEL_MIN_PARTICLES;
+    }
+
+    template<typename TCallback>
+    static void forEach(PhysicSolver& solver, TCallback&& callback)
+    {
+        if (!isParallel(solver)) {
+            SerialExecution::forEach(solver, callback);
+            return;
+        }
+        Particle* const particles = solver.objects.data.data() + solver.pinned_count;
+        solver.thread_pool->dispatch(solver.objects.size() - solver.pinned_count, [&](uint64_t start, uint64_t end) {
+            for (uint64_t i(start); i < end; ++i) {
+                callback(particles[i]);
+            }
+        });
+    }
+
+    template<typename TCallback>
+    static float reduceMax(PhysicSolver& solver, TCallback&& callback)
+    {
+        if (!isParallel(solver)) {
+            return SerialExecution::reduceMax(solver, callback);
+        }
+        // One maximum per batch, reduced afterward
+        std::vector<float>& maxima = solver.batch_max_velocity2;
+        maxima.assign(solver.thread_pool->thread_count, 0.0f);
+        const uint64_t first = solver.pinned_count;
+        solver.thread_pool->dispatchIndexed(solver.objects.size() - first, [&](uint32_t batch, uint64_t start, uint64_t end) {
+            maxima[batch] = callback(first + start, first + end);
+        });
+        return *std::max_element(maxima.begin(), maxima.end());
+    }
+};
+
+
+template<typename TIntegrator, typename TFriction, typename TConstraint, typename TWind, typename TExecution>
+struct SpecializedKernel : public SolverKernel
+{
+    std::string name;
+    std::vector<RectWind::Area> wind_areas;
+    // XPBD only, in links data order, rebuilt with the topology. previous_dt
+    // is the sub-step duration of the multipliers, 0 when there are none to
+    // warm start
+    std::vector<XPBDMultiplier> multipliers;
+    uint64_t multipliers_version = ~uint64_t(0);
+    float previous_dt = 0.0f;
+
+    explicit
+    SpecializedKernel(const char* constraint_name = TConstraint::NAME)
+        : name(std::string(TIntegrator::NAME) + "/" + TFriction::NAME + "/" + constraint_name + "/"
+               + TWind::NAME + "/" + TExecution::NAME)
+    {}
+
+    const std::string& getName() const override
+    {
+        return name;
+    }
+
+    void update(PhysicSolver& solver, float dt) override
+    {
+        const float sub_step_dt = dt / to<float>(solver.sub_steps);
+        solver.motion = 0.0f;
+        for (uint32_t i(solver.sub_steps); i--;) {
+            integrate(solver, sub_step_dt);
+            solveConstraints(solver, sub_step_dt);
+            updateDerivatives(solver, sub_step_dt);
+        }
+    }
+
+    void integrate(PhysicSolver& solver, float dt) override
+    {
+        PROFILE_SCOPE("integrate");
+        PERF_SCOPE("integrate", solver.objects.size());
+        const Vec2 gravity = solver.gravity;
+        const float friction_coef = solver.friction_coef;
+        TExecution::forEach(solver, [gravity, friction_coef, dt](Particle& p) {
+            p.forces += gravity * p.mass;
+            TFriction::apply(p, friction_coef);
+            TIntegrator::integrate(p, dt);
+        });
+    }
+
+    void solveConstraints(PhysicSolver& solver, float dt) override
+    {
+        PROFILE_SCOPE("constraints");
+        PERF_SCOPE("constraints", solver.constraints.size());
+        if (!solver.solver_iterations) { return; }
+        LinkConstraint* const links = solver.constraints.data.data();
+        const uint64_t links_count = solver.constraints.size();
+        const float inv_dt2 = 1.0f / (dt * dt);
+        // The kernels without multipliers all get the same unused one
+        XPBDMultiplier unused;
+        constexpr uint64_t multiplier_step = TConstraint::MULTIPLIERS ? 1 : 0;
+        XPBDMultiplier* const multiplier = TConstraint::MULTIPLIERS ? prepareMultipliers(solver, dt) : &unused;
+        // Optional coarse corrections, the links passes then smooth them out
+        solver.multigrid.solve(solver);
+        solver.long_range.solve(solver);
+        // The last sweep is not extrapolated, it settles the links and measures them
+        const bool accelerated = TConstraint::ACCELERATED && solver.chebyshev.enabled && solver.solver_iterations > 2;
+        if (accelerated) {
+            solver.chebyshev.begin(solver);
+        }
+        // Gauss-Seidel, each link sees the corrections of the previous ones
+        for (uint32_t i(1); i < solver.solver_iterations; ++i) {
+            for (uint64_t k(0); k < links_count; ++k) {
+                TConstraint::solve(links[k], multiplier[k * multiplier_step], inv_dt2);
+            }
+            solveGroup<ShearLink, false>(solver.shear_links);
+            solveGroup<BendLink, false>(solver.bend_links);
+            if (accelerated) {
+                solver.chebyshev.step(solver);
+            }
+        }
+        // The last iteration also records and checks the elongation of each
+        // link, of every kind
+        for (uint64_t k(0); k < links_count; ++k) {
+            const float length = TConstraint::solve(links[k], multiplier[k * multiplier_step], inv_dt2);
+            LinkInfo& info = solver.constraints.cold[k];
+            info.length = length;
+            if (info.isBroken(links[k], length)) {
+                solver.broken_links.push_back(info.id);
+            }
+        }
+        solveGroup<ShearLink, true>(solver.shear_links);
+        solveGroup<BendLink, true>(solver.bend_links);
+        solver.eraseBrokenLinks();
+    }
+
+    // Starts the multipliers from a share of the previous sub-step ones, or
+    // from zero when the links changed
+    XPBDMultiplier* prepareMultipliers(const PhysicSolver& solver, float dt)
+    {
+        const uint64_t links_count = solver.constraints.size();
+        if (multipliers_version != solver.topology_version || multipliers.size() != links_count) {
+            multipliers.resize(links_count);
+            for (uint64_t k(0); k < links_count; ++k) {
+                multipliers[k] = {solver.constraints.cold[k].compliance, 0.0f};
+            }
+            multipliers_version = solver.topology_version;
+        } else if (previous_dt > 0.0f) {
+            // Multipliers scale with the squared sub-step duration
+            const float scale = solver.warm_start * (dt * dt) / (previous_dt * previous_dt);
+            for (XPBDMultiplier& multiplier : multipliers) {
+                multiplier.lambda *= scale;
+            }
+        }
+        previous_dt = dt;
+        return multipliers.data();
+    }
+
+    // One pass over the links of a kind, the last one also checks breakage
+    template<typename TKind, bool LAST>
+    static void solveGroup(LinkGroup& group)
+    {
+        LinkConstraint* const links = group.links.data.data();
+        const uint64_t links_count = group.links.size();
+        for (uint64_t k(0); k < links_count; ++k) {
+            const float length = TKind::solve(links[k]);
+            if constexpr (LAST) {
+                LinkInfo& info = group.links.cold[k];
+                info.length = length;
+                if (info.isBroken(links[k], length)) {
+                    group.broken_links.push_back(info.id);
+                }
+            }
+        }
+    }
+
+    void updateDerivatives(PhysicSolver& solver, float dt) override
+    {
+        PROFILE_SCOPE("derivatives");
+        PERF_SCOPE("derivatives", solver.objects.size());
+        Particle* const particles = solver.objects.data.data();
+        const float max_velocity2 = TExecution::reduceMax(solver, [particles, dt](uint64_t start, uint64_t end) {
+            float max_v2 = 0.0f;
+            for (uint64_t i(start); i < end; ++i) {
+                Particle& p = particles[i];
+                p.updateDerivatives(dt);
+                max_v2 = std::max(max_v2, p.velocity.x * p.velocity.x + p.velocity.y * p.velocity.y);
+            }
+            return max_v2;
+        });
+        solver.motion += std::sqrt(max_velocity2) * dt;
+    }
+
+    void applyWind(PhysicSolver& solver, const std::vector<Wind>& winds, float dt) override
+    {
+        PROFILE_SCOPE("wind");
+        TWind::prepare(wind_areas, winds, dt);
+        // One pass per area, a local copy keeps it in registers
+        for (const RectWind::Area& area : wind_areas) {
+            TExecution::forEach(solver, [area](Particle& p) {
+                TWind::apply(p, area);
+            });
+        }
+    }
+};
+
+
+/* Same passes, except that the links are solved by projective dynamics
+ * instead of the Gauss-Seidel loop. The factorized system is kept by the
+ * kernel, it is rebuilt along with the kernel. */
+template<typename TIntegrator, typename TFriction, typename TWind, typename TExecution>
+struct ProjectiveDynamicsKernel : public SpecializedKernel<TIntegrator, TFriction, DistanceConstraint, TWind, TExecution>
+{
+    ProjectiveDynamics projective_dynamics;
+
+    ProjectiveDynamicsKernel()
+        : SpecializedKernel<TIntegrator, TFriction, DistanceConstraint, TWind, TExecution>(ProjectiveDynamicsConstraint::NAME)
+    {}
+
+    void solveConstraints(PhysicSolver& solver, float dt) override
+    {
+        PROFILE_SCOPE("constraints");
+        PERF_SCOPE("constraints", solver.constraints.size());
+        if (!solver.solver_iterations) { return; }
+        projective_dynamics.solve(solver, dt);
+        // Same breakage rule as the iterative solvers, on the final lengths
+        LinkConstraint* const links = solver.constraints.data.data();
+        const uint64_t links_count = solver.constraints.size();
+        for (uint64_t k(0); k < links_count; ++k) {
+            const float length = (links[k].particle_1->position - links[k].particle_2->position).getLength();
+            LinkInfo& info = solver.constraints.cold[k];
+            info.length = length;
+            if (info.isBroken(links[k], length)) {
+                solver.broken_links.push_back(info.id);
+            }
+        }
+        solver.eraseBrokenLinks();
+    }
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
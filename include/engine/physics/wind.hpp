@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include "engine/common/vec.hpp"
+#include "physics.hpp"
+
+
+struct Wind
+{
+    FloatRect rect;
+    Vec2 force;
+
+    Wind(Vec2 s, Vec2 p, Vec2 f)
+        : rect(p, s)
+        , force(f)
+    {}
+
+    void update(float dt)
+    {
+        rect.left += 1.0f * force.x * dt;
+        //rect.top += force.y * dt;
+    }
+};
+
+
+struct WindManager
+{
+    std::vector<Wind> winds;
+    float world_width = 0.0f;
+
+    explicit
+    WindManager(float width)
+        : world_width(width)
+    {}
+
+    void update(PhysicSolver& solver, float dt);
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -0,0 +1,34 @@
+#pragma once
+#include <SFML/Graphics/Color.hpp>
+#include <SFML/System/Vector2.hpp>
+#include "engine/common/color.hpp"
+#include "engine/common/utils.hpp"
+#include "engine/common/vec.hpp"
+
+
+/* The physics does not depend on SFML, its types are converted here, where
+ * they reach the renderer or come from the window */
+
+inline sf::Vector2f toSf(const Vec2& v)
+{
+    return {v.x, v.y};
+}
+
+inline sf::Color toSf(const Color& c)
+{
+    return {c.r, c.g, c.b, c.a};
+}
+
+template<typename T>
+Vec2 toVec2(const sf::Vector2<T>& v)
+{
+    return {to<float>(v.x), to<float>(v.y)};
+}
+
+template<typename T>
+sf::Vector2f toVector2f(sf::Vector2<T> v)
+{
+    return {to<float>(v.x), to<float>(v.y)};
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */
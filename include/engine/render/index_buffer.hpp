@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include <SFML/OpenGL.hpp>
+
+// OpenGL 1.5 names, not declared by every platform gl.h
+#ifndef GL_ELEMENT_ARRAY_BUFFER
+    #define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#endif
+#ifndef GL_STATIC_DRAW
+    #define GL_STATIC_DRAW 0x88E4
+#endif
+#ifndef APIENTRY
+    #define APIENTRY
+#endif
+
+
+/* Index list stored in an OpenGL element array buffer, the counterpart of
+ * sf::VertexBuffer which SFML does not provide. The buffer functions are
+ * resolved through sf::Context::getFunction on first use, which needs an
+ * active context; isAvailable returns false when the driver lacks them.
+ * Uploads replace the whole list, they are meant to follow topology changes.
+ */
+struct IndexBuffer
+{
+    using GenBuffers    = void (APIENTRY*)(GLsizei, GLuint*);
+    using DeleteBuffers = void (APIENTRY*)(GLsizei, const GLuint*);
+    using BindBuffer    = void (APIENTRY*)(GLenum, GLuint);
+    using BufferData    = void (APIENTRY*)(GLenum, std::ptrdiff_t, const void*, GLenum);
+
+    struct Functions
+    {
+        GenBuffers    gen_buffers    = nullptr;
+        DeleteBuffers delete_buffers = nullptr;
+        BindBuffer    bind_buffer    = nullptr;
+        BufferData    buffer_data    = nullptr;
+        bool          loaded         = false;
+    };
+
+    GLuint   handle = 0;
+    // Number of indices of the last upload
+    uint64_t count  = 0;
+
+    IndexBuffer() = default;
+
+    IndexBuffer(const IndexBuffer&) = delete;
+    IndexBuffer& operator=(const IndexBuffer&) = delete;
+
+    ~IndexBuffer()
+    {
+        if (handle) {
+            getFunctions().delete_buffers(1, &handle);
+        }
+    }
+
+    static Functions& getFunctions()
+    {
+        static Functions functions;
+        if (!functions.loaded) {
+            functions.loaded = true;
+            functions.gen_buffers    = reinterpret_cast<GenBuffers>(sf::Context::getFunction("glGenBuffers"));
+            functions.delete_buffers = reinterpret_cast<DeleteBuffers>(sf::Context::getFunction("glDeleteBuffers"));
+            functions.bind_buffer    = reinterpret_cast<BindBuffer>(sf::Context::getFunction("glBindBuffer"));
+            functions.buffer_data    = reinterpret_cast<BufferData>(sf::Context::getFunction("glBufferData"));
+        }
+        return functions;
+    }
+
+    static bool isAvailable()
+    {
+        const Functions& f = getFunctions();
+        return f.gen_buffers && f.delete_buffers && f.bind_buffer && f.buffer_data;
+    }
+
+    void update(const std::vector<uint32_t>& indices)
+    {
+        const Functions& f = getFunctions();
+        if (!handle) {
+            f.gen_buffers(1, &handle);
+        }
+        f.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, handle);
+        f.buffer_data(GL_ELEMENT_ARRAY_BUFFER, static_cast<std::ptrdiff_t>(indices.size() * sizeof(uint32_t)),
+                      indices.data(), GL_STATIC_DRAW);
+        f.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        count = indices.size();
+    }
+
+    // nullptr unbinds, index pointers are then client side addresses again
+    static void bind(const IndexBuffer* buffer)
+    {
+        getFunctions().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, buffer ? buffer->handle : 0);
+    }
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include <SFML/OpenGL.hpp>
+#include "index_buffer.hpp"
+
+
+struct IndexRange
+{
+    uint32_t first;
+    uint32_t count;
+};
+
+
+/* Lines drawn from shared vertices and an index list with glDrawElements,
+ * which SFML does not expose. All the arrays are owned by the caller; when a
+ * vertex buffer holding a copy of the vertices is set, it is used instead of
+ * the client side array, and likewise for an index buffer holding a copy of
+ * the indices. When ranges are set only these parts of the index list are
+ * drawn.
+ */
+struct IndexedLines : public sf::Drawable
+{
+    const std::vector<sf::Vertex>* vertices = nullptr;
+    const std::vector<uint32_t>*   indices  = nullptr;
+    const sf::VertexBuffer*        buffer   = nullptr;
+    const IndexBuffer*             index_buffer = nullptr;
+    const std::vector<IndexRange>* ranges   = nullptr;
+
+    IndexedLines() = default;
+
+    IndexedLines(const std::vector<sf::Vertex>& v, const std::vector<uint32_t>& i)
+        : vertices(&v)
+        , indices(&i)
+    {}
+
+    void setBuffer(const sf::VertexBuffer* b)
+    {
+        buffer = b;
+    }
+
+    void setIndexBuffer(const IndexBuffer* b)
+    {
+        index_buffer = b;
+    }
+
+private:
+    void draw(sf::RenderTarget& target, sf::RenderStates states) const override
+    {
+        if (!vertices || !indices || vertices->empty() || indices->empty()) {
+            return;
+        }
+        target.pushGLStates();
+        // Same view setup as SFML does before its own draw calls
+        const sf::View view = target.getView();
+        const sf::IntRect viewport = target.getViewport(view);
+        const int32_t top = static_cast<int32_t>(target.getSize().y) - (viewport.top + viewport.height);
+        glViewport(viewport.left, top, viewport.width, viewport.height);
+        glMatrixMode(GL_PROJECTION);
+        glLoadMatrixf(view.getTransform().getMatrix());
+        glMatrixMode(GL_MODELVIEW);
+        glLoadMatrixf(states.transform.getMatrix());
+
+        // With a bound buffer the pointers are offsets into it
+        const bool use_buffer = buffer && buffer->getVertexCount() >= vertices->size();
+        const uintptr_t base = use_buffer ? 0 : reinterpret_cast<uintptr_t>(vertices->data());
+        if (use_buffer) {
+            sf::VertexBuffer::bind(buffer);
+        }
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glVertexPointer(2, GL_FLOAT, sizeof(sf::Vertex), reinterpret_cast<const void*>(base + offsetof(sf::Vertex, position)));
+        glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(sf::Vertex), reinterpret_cast<const void*>(base + offsetof(sf::Vertex, color)));
+        // Same for the indices, ranges become byte offsets into the buffer
+        const bool use_index_buffer = index_buffer && index_buffer->count == indices->size();
+        const uintptr_t index_base = use_index_buffer ? 0 : reinterpret_cast<uintptr_t>(indices->data());
+        if (use_index_buffer) {
+            IndexBuffer::bind(index_buffer);
+        }
+        if (ranges) {
+            for (const IndexRange& range : *ranges) {
+                glDrawElements(GL_LINES, static_cast<GLsizei>(range.count), GL_UNSIGNED_INT,
+                               reinterpret_cast<const void*>(index_base + range.first * sizeof(uint32_t)));
+            }
+        } else {
+            glDrawElements(GL_LINES, static_cast<GLsizei>(indices->size()), GL_UNSIGNED_INT,
+                           reinterpret_cast<const void*>(index_base));
+        }
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        if (use_index_buffer) {
+            IndexBuffer::bind(nullptr);
+        }
+        if (use_buffer) {
+            sf::VertexBuffer::bind(nullptr);
+        }
+        target.popGLStates();
+    }
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -0,0 +1,118 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "indexed_lines.hpp"
+
+
+/* Coarse spatial partition of an indexed lines list used for culling.
+ *
+ * Particles are grouped by tiles of TILE_SIZE consecutive vertices, which are
+ * spatially coherent since the cloth is built row by row. Each line belongs
+ * to the tile of its first vertex; its second vertex is at most margin away,
+ * so a tile is visible if its particles bounds grown by margin intersect the
+ * view. Lines are sorted by tile so that visible tiles map to index ranges.
+ */
+struct LinkTiles
+{
+    static constexpr uint32_t TILE_SIZE = 1024;
+
+    struct Bounds
+    {
+        sf::Vector2f min;
+        sf::Vector2f max;
+
+        void reset()
+        {
+            min = { std::numeric_limits<float>::max(),  std::numeric_limits<float>::max()};
+            max = {-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()};
+        }
+
+        void add(sf::Vector2f p)
+        {
+            min.x = std::min(min.x, p.x);
+            min.y = std::min(min.y, p.y);
+            max.x = std::max(max.x, p.x);
+            max.y = std::max(max.y, p.y);
+        }
+
+        bool intersects(sf::Vector2f view_min, sf::Vector2f view_max, float margin) const
+        {
+            return min.x - margin <= view_max.x && max.x + margin >= view_min.x
+                && min.y - margin <= view_max.y && max.y + margin >= view_min.y;
+        }
+    };
+
+    // Index list sorted by tile, lines of tile t are in [offsets[t], offsets[t + 1])
+    struct Batch
+    {
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> offsets;
+    };
+
+    uint32_t            tiles_count = 0;
+    std::vector<Bounds> bounds;
+    float               margin = 0.0f;
+
+    void resize(uint64_t vertices_count)
+    {
+        tiles_count = static_cast<uint32_t>((vertices_count + TILE_SIZE - 1) / TILE_SIZE);
+        bounds.resize(tiles_count);
+    }
+
+    // Sorts the lines (pairs of vertex indices) by tile
+    void sort(const std::vector<uint32_t>& lines, Batch& batch) const
+    {
+        const uint64_t lines_count = lines.size() / 2;
+        batch.offsets.assign(tiles_count + 1, 0);
+        for (uint64_t i(0); i < lines_count; ++i) {
+            ++batch.offsets[lines[2 * i] / TILE_SIZE + 1];
+        }
+        for (uint32_t t(1); t <= tiles_count; ++t) {
+            batch.offsets[t] += batch.offsets[t - 1];
+        }
+        std::vector<uint32_t> cursors(batch.offsets.begin(), batch.offsets.end() - 1);
+        batch.indices.resize(lines.size());
+        for (uint64_t i(0); i < lines_count; ++i) {
+            const uint32_t line = cursors[lines[2 * i] / TILE_SIZE]++;
+            batch.indices[2 * line    ] = lines[2 * i    ];
+            batch.indices[2 * line + 1] = lines[2 * i + 1];
+        }
+    }
+
+    void updateBounds(const std::vector<sf::Vertex>& vertices)
+    {
+        const uint64_t vertices_count = vertices.size();
+        for (uint32_t t(0); t < tiles_count; ++t) {
+            Bounds& b = bounds[t];
+            b.reset();
+            const uint64_t end = std::min<uint64_t>(vertices_count, (t + 1) * uint64_t(TILE_SIZE));
+            for (uint64_t i(t * uint64_t(TILE_SIZE)); i < end; ++i) {
+                b.add(vertices[i].position);
+            }
+        }
+    }
+
+    // Index ranges of the visible tiles, adjacent tiles are merged
+    void getVisibleRanges(const Batch& batch, sf::Vector2f view_min, sf::Vector2f view_max,
+                          std::vector<IndexRange>& ranges) const
+    {
+        ranges.clear();
+        for (uint32_t t(0); t < tiles_count; ++t) {
+            const uint32_t first = 2 * batch.offsets[t];
+            const uint32_t count = 2 * (batch.offsets[t + 1] - batch.offsets[t]);
+            if (!count || !bounds[t].intersects(view_min, view_max, margin)) {
+                continue;
+            }
+            if (!ranges.empty() && ranges.back().first + ranges.back().count == first) {
+                ranges.back().count += count;
+            } else {
+                ranges.push_back({first, count});
+            }
+        }
+    }
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -0,0 +1,242 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "../common/profiler.hpp"
+#include "../common/thread_pool.hpp"
+#include "../common/utils.hpp"
+
+
+/* CPU line rasterizer used to capture frames without a window.
+ *
+ * Draws the same indexed lines as IndexedLines: vertices are transformed by the
+ * viewport transform, lines are clipped to the frame and binned by horizontal
+ * band, then each thread rasterizes whole bands so that no two threads write
+ * the same pixel. Each pixel of a line only depends on the line itself, so the
+ * output does not depend on the threads count.
+ */
+struct SoftwareRasterizer
+{
+    // Height in pixels of the bands the lines are binned into
+    static constexpr uint32_t BAND_HEIGHT = 32;
+
+    struct Line
+    {
+        sf::Vector2f p_1;
+        sf::Vector2f p_2;
+        sf::Color    color_1;
+        sf::Color    color_2;
+    };
+
+    uint32_t                 width;
+    uint32_t                 height;
+    uint32_t                 bands_count;
+    std::vector<sf::Color>   pixels;
+    tp::ThreadPool&          thread_pool;
+    std::vector<sf::Vector2f> screen_positions;
+    std::vector<Line>        lines;
+    // Clipped lines of each band, one list per thread and per band
+    std::vector<std::vector<uint32_t>> bins;
+
+    SoftwareRasterizer(uint32_t w, uint32_t h, tp::ThreadPool& tp)
+        : width(w)
+        , height(h)
+        , bands_count((h + BAND_HEIGHT - 1) / BAND_HEIGHT)
+        , pixels(uint64_t(w) * h)
+        , thread_pool(tp)
+        , bins(uint64_t(tp.thread_count) * bands_count)
+    {}
+
+    void clear(sf::Color color = sf::Color::Black)
+    {
+        PROFILE_SCOPE("clear");
+        const uint64_t pixels_count = pixels.size();
+        thread_pool.dispatch(pixels_count, [&](uint64_t start, uint64_t end) {
+            std::fill(pixels.begin() + start, pixels.begin() + end, color);
+        });
+    }
+
+    // Draws the lines given as pairs of vertex indices, like IndexedLines
+    void draw(const std::vector<sf::Vertex>& vertices, const std::vector<uint32_t>& indices,
+              const sf::Transform& transform)
+    {
+        PROFILE_SCOPE("rasterize");
+        const uint64_t vertices_count = vertices.size();
+        screen_positions.resize(vertices_count);
+        thread_pool.dispatch(vertices_count, [&](uint64_t start, uint64_t end) {
+            for (uint64_t i(start); i < end; ++i) {
+                screen_positions[i] = transform.transformPoint(vertices[i].position);
+            }
+        });
+        // Clip and bin, each thread fills its own bins in lines order
+        const uint64_t lines_count = indices.size() / 2;
+        lines.resize(lines_count);
+        const uint64_t batch_size = lines_count / thread_pool.thread_count;
+        for (uint32_t t(0); t < thread_pool.thread_count; ++t) {
+            const uint64_t start = batch_size * t;
+            const uint64_t end   = (t == thread_pool.thread_count - 1) ? lines_count : start + batch_size;
+            thread_pool.addTask([&, t, start, end] {
+                PROFILE_SCOPE("bin lines");
+                binLines(vertices, indices, t, start, end);
+            });
+        }
+        thread_pool.waitForCompletion();
+        // Bands are interleaved between threads to balance the load
+        const uint32_t thread_count = thread_pool.thread_count;
+        for (uint32_t t(0); t < thread_count; ++t) {
+            thread_pool.addTask([&, t] {
+                PROFILE_SCOPE("draw bands");
+                for (uint32_t band(t); band < bands_count; band += thread_count) {
+                    drawBand(band);
+                }
+            });
+        }
+        thread_pool.waitForCompletion();
+    }
+
+    bool saveToFile(const std::string& path) const
+    {
+        return saveToFile(path, width, height, pixels);
+    }
+
+    // Binary PPM (P6), alpha is dropped
+    static bool savePPM(const std::string& path, uint32_t width, uint32_t height,
+                        const std::vector<sf::Color>& pixels)
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        file << "P6\n" << width << " " << height << "\n255\n";
+        std::vector<char> row(3 * uint64_t(width));
+        for (uint32_t y(0); y < height; ++y) {
+            const sf::Color* src = &pixels[uint64_t(y) * width];
+            for (uint32_t x(0); x < width; ++x) {
+                row[3 * x    ] = static_cast<char>(src[x].r);
+                row[3 * x + 1] = static_cast<char>(src[x].g);
+                row[3 * x + 2] = static_cast<char>(src[x].b);
+            }
+            file.write(row.data(), static_cast<std::streamsize>(row.size()));
+        }
+        return static_cast<bool>(file);
+    }
+
+    // Format is selected by the file extension, .ppm is written directly
+    static bool saveToFile(const std::string& path, uint32_t width, uint32_t height,
+                           const std::vector<sf::Color>& pixels)
+    {
+        const std::string::size_type dot = path.rfind('.');
+        if (dot != std::string::npos && path.substr(dot) == ".ppm") {
+            return savePPM(path, width, height, pixels);
+        }
+        sf::Image image;
+        image.create(width, height, reinterpret_cast<const sf::Uint8*>(pixels.data()));
+        return image.saveToFile(path);
+    }
+
+private:
+    // Liang-Barsky clipping of the segment p + t * d, t in [t_0, t_1]
+    static bool clipEdge(float q, float r, float& t_0, float& t_1)
+    {
+        if (q == 0.0f) {
+            return r >= 0.0f;
+        }
+        const float t = r / q;
+        if (q < 0.0f) {
+            if (t > t_1) { return false; }
+            t_0 = std::max(t_0, t);
+        } else {
+            if (t < t_0) { return false; }
+            t_1 = std::min(t_1, t);
+        }
+        return true;
+    }
+
+    void binLines(const std::vector<sf::Vertex>& vertices, const std::vector<uint32_t>& indices,
+                  uint32_t thread_id, uint64_t start, uint64_t end)
+    {
+        std::vector<uint32_t>* thread_bins = &bins[uint64_t(thread_id) * bands_count];
+        for (uint32_t band(0); band < bands_count; ++band) {
+            thread_bins[band].clear();
+        }
+        // Pixel centers are at integer + 0.5, keep the lines inside the frame
+        const float max_x = to<float>(width)  - 0.5f;
+        const float max_y = to<float>(height) - 0.5f;
+        for (uint64_t i(start); i < end; ++i) {
+            const uint32_t index_1 = indices[2 * i];
+            const uint32_t index_2 = indices[2 * i + 1];
+            const sf::Vector2f p = screen_positions[index_1];
+            const sf::Vector2f d = screen_positions[index_2] - p;
+            float t_0 = 0.0f;
+            float t_1 = 1.0f;
+            if (!clipEdge(-d.x, p.x - 0.5f, t_0, t_1) || !clipEdge(d.x, max_x - p.x, t_0, t_1) ||
+                !clipEdge(-d.y, p.y - 0.5f, t_0, t_1) || !clipEdge(d.y, max_y - p.y, t_0, t_1)) {
+                continue;
+            }
+            const sf::Color c_1 = vertices[index_1].color;
+            const sf::Color c_2 = vertices[index_2].color;
+            Line& line = lines[i];
+            line.p_1 = p + t_0 * d;
+            line.p_2 = p + t_1 * d;
+            line.color_1 = lerp(c_1, c_2, t_0);
+            line.color_2 = lerp(c_1, c_2, t_1);
+            const uint32_t first_band = static_cast<uint32_t>(std::min(line.p_1.y, line.p_2.y)) / BAND_HEIGHT;
+            const uint32_t last_band  = static_cast<uint32_t>(std::max(line.p_1.y, line.p_2.y)) / BAND_HEIGHT;
+            for (uint32_t band(first_band); band <= last_band; ++band) {
+                thread_bins[band].push_back(static_cast<uint32_t>(i));
+            }
+        }
+    }
+
+    void drawBand(uint32_t band)
+    {
+        const int32_t band_min = static_cast<int32_t>(band * BAND_HEIGHT);
+        const int32_t band_max = std::min<int32_t>(band_min + BAND_HEIGHT, static_cast<int32_t>(height));
+        for (uint32_t t(0); t < thread_pool.thread_count; ++t) {
+            for (const uint32_t i : bins[uint64_t(t) * bands_count + band]) {
+                drawLine(lines[i], band_min, band_max);
+            }
+        }
+    }
+
+    // DDA along the major axis, only the pixels in [band_min, band_max) are written
+    void drawLine(const Line& line, int32_t band_min, int32_t band_max)
+    {
+        const sf::Vector2f d = line.p_2 - line.p_1;
+        const uint32_t steps = static_cast<uint32_t>(std::max(std::abs(d.x), std::abs(d.y)));
+        const float inv_steps = steps ? 1.0f / to<float>(steps) : 0.0f;
+        const sf::Vector2f step = d * inv_steps;
+        uint32_t k_min = 0;
+        uint32_t k_max = steps;
+        // Restrict the steps to the band, with one step of slack on each side
+        if (step.y != 0.0f) {
+            const float k_0 = (to<float>(band_min) - line.p_1.y) / step.y;
+            const float k_1 = (to<float>(band_max) - line.p_1.y) / step.y;
+            k_min = static_cast<uint32_t>(std::max(0.0f, std::min(k_0, k_1) - 1.0f));
+            k_max = static_cast<uint32_t>(std::min(to<float>(steps), std::max(k_0, k_1) + 1.0f));
+        }
+        for (uint32_t k(k_min); k <= k_max; ++k) {
+            const float fk = to<float>(k);
+            const int32_t y = static_cast<int32_t>(line.p_1.y + fk * step.y);
+            if (y < band_min || y >= band_max) {
+                continue;
+            }
+            const int32_t x = static_cast<int32_t>(line.p_1.x + fk * step.x);
+            pixels[uint64_t(y) * width + x] = lerp(line.color_1, line.color_2, fk * inv_steps);
+        }
+    }
+
+    static sf::Color lerp(sf::Color c_1, sf::Color c_2, float t)
+    {
+        const auto mix = [t](sf::Uint8 a, sf::Uint8 b) {
+            return static_cast<sf::Uint8>(to<float>(a) + t * (to<float>(b) - to<float>(a)));
+        };
+        return {mix(c_1.r, c_2.r), mix(c_1.g, c_2.g), mix(c_1.b, c_2.b), mix(c_1.a, c_2.a)};
+    }
+};
+
+/* vim: set ts=4 sts=4 sw=4 et: */
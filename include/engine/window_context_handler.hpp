@@ -3,6 +3,7 @@
 #include "render/viewport_handler.hpp"
 #include "common/event_manager.hpp"
 #include "common/utils.hpp"
+#include "render/conversions.hpp"
 
 
 class WindowContextHandler;
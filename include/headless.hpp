@@ -0,0 +1,10 @@
+/* Windowless simulation with optional frame capture */
+
+#pragma once
+#include "config.hpp"
+
+/* Simulate conf.frames_count frames, rasterize them on the CPU and write them
+ * to conf.capture_path if set; returns the process exit status */
+int runHeadless(const config& conf);
+
+/* vim: set ts=4 sts=4 sw=4 et: */
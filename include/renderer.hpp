@@ -1,53 +1,292 @@
 #pragma once
+#include <vector>
 #include <SFML/Graphics.hpp>
 #include "engine/physics/physics.hpp"
+#include "engine/render/conversions.hpp"
 #include "engine/window_context_handler.hpp"
+#include "engine/render/indexed_lines.hpp"
+#include "engine/render/link_tiles.hpp"
+#include "cloth_mesh.hpp"
 
 enum ColorMode
 {
+    // Particles colors
     Default = 0,
+    // Links strain, from green at rest length to red when about to break
     Gradient
 };
 
+// Accumulated particle motion under which the vertex upload is skipped
+const float RENDER_MOTION_THRESHOLD = 0.001f;
+// On screen length of the links under which a decimated set of links is drawn
+const float LOD_MIN_LINK_PIXELS = 2.0f;
+// Coarsest level of detail, draws one link out of 2^LOD_MAX_LEVEL
+const uint32_t LOD_MAX_LEVEL = 4;
+
+enum RenderMode
+{
+    // One vertex per particle, links drawn from an index list
+    Indexed = 0,
+    // Two vertices per link
+    Lines
+};
+
 struct Renderer
 {
     PhysicSolver& solver;
     sf::VertexArray va;
     ColorMode cm;
+    RenderMode rm;
+    // Indexed mode data, indices are rebuilt only when the topology changes,
+    // colors only when they change and positions only when particles move
+    ClothMesh mesh;
+    sf::VertexBuffer vertex_buffer;
+    bool colors_dirty;
+    float pending_motion;
+    IndexedLines indexed_lines;
+    // Checked on first render, which needs a GL context
+    bool buffer_checked;
+    // Culling and level of detail, one batch of tile sorted links per level
+    bool culling;
+    bool level_of_detail;
+    uint32_t grid_width;
+    float max_link_length;
+    LinkTiles tiles;
+    std::vector<LinkTiles::Batch> lods;
+    std::vector<uint64_t> lods_versions;
+    std::vector<uint32_t> lod_lines;
+    std::vector<IndexRange> ranges;
+    // Copies of the levels index lists in GPU memory, uploaded when a level is
+    // rebuilt; empty when index buffers are not available
+    std::vector<IndexBuffer> index_buffers;
+    std::vector<uint64_t> index_buffers_versions;
 
     explicit
     Renderer(PhysicSolver& s)
         : solver(s)
         , va(sf::Lines)
         , cm(ColorMode::Default)
+        , rm(RenderMode::Indexed)
+        , mesh(s)
+        , vertex_buffer(sf::Lines, sf::VertexBuffer::Stream)
+        , colors_dirty(true)
+        , pending_motion(0.0f)
+        , indexed_lines(mesh.vertices, mesh.indices)
+        , buffer_checked(false)
+        , culling(true)
+        , level_of_detail(true)
+        , grid_width(0)
+        , max_link_length(0.0f)
+        , lods(LOD_MAX_LEVEL + 1)
+        , lods_versions(LOD_MAX_LEVEL + 1, s.topology_version - 1)
     {}
 
     void setColorMode(ColorMode cmode)
     {
         cm = cmode;
+        colors_dirty = true;
+    }
+
+    // To be called after changing particles colors
+    void invalidateColors()
+    {
+        colors_dirty = true;
+    }
+
+    void setCulling(bool enable)
+    {
+        culling = enable;
+    }
+
+    void setLevelOfDetail(bool enable)
+    {
+        level_of_detail = enable;
+    }
+
+    // Width of the grid the cloth was built from, used to decimate links along
+    // rows and columns; with 0 the decimated levels keep one link out of n
+    void setGridWidth(uint32_t width)
+    {
+        grid_width = width;
+        std::fill(lods_versions.begin() + 1, lods_versions.end(), mesh.topology_version - 1);
+    }
+
+    void setRenderMode(RenderMode rmode)
+    {
+        rm = rmode;
+        // Vertices are not maintained in the other modes
+        colors_dirty = true;
     }
 
     void updateVA()
     {
+        PROFILE_SCOPE("update va");
         const uint32_t links_count = to<uint32_t>(solver.constraints.size());
         va.resize(2 * links_count);
         for (uint32_t i = 0; i < links_count; ++i) {
             LinkConstraint& current_link = solver.constraints.data[i];
-            va[2 * i    ].position = current_link.particle_1->position;
-            va[2 * i + 1].position = current_link.particle_2->position;
+            va[2 * i    ].position = toSf(current_link.particle_1->position);
+            va[2 * i + 1].position = toSf(current_link.particle_2->position);
             if (cm == ColorMode::Default) {
-                va[2 * i    ].color = current_link.particle_1->color;
-                va[2 * i + 1].color = current_link.particle_2->color;
+                va[2 * i    ].color = toSf(current_link.particle_1->color);
+                va[2 * i + 1].color = toSf(current_link.particle_2->color);
             } else if (cm == ColorMode::Gradient) {
-                // TODO: Not implemented yet
+                // Measured by the solver, no need to recompute the links length
+                const sf::Color color = getStrainColor(solver.constraints.cold[i].getStrain(current_link));
+                va[2 * i    ].color = color;
+                va[2 * i + 1].color = color;
             }
         }
     }
 
+    static sf::Color getStrainColor(float strain)
+    {
+        const float t = std::min(strain, 1.0f);
+        const auto r = to<sf::Uint8>(255.0f * std::min(1.0f, 2.0f * t));
+        const auto g = to<sf::Uint8>(255.0f * std::min(1.0f, 2.0f * (1.0f - t)));
+        return {r, g, 0};
+    }
+
+    // Returns true if the topology changed since the last call
+    bool updateIndices()
+    {
+        if (!mesh.updateIndices(solver)) {
+            return false;
+        }
+        const uint64_t links_count = solver.constraints.size();
+        max_link_length = 0.0f;
+        tiles.margin = 0.0f;
+        for (uint64_t i = 0; i < links_count; ++i) {
+            const float distance = solver.constraints.data[i].distance;
+            // Longer links are broken by the solver
+            max_link_length = std::max(max_link_length, distance);
+            tiles.margin = std::max(tiles.margin, distance * solver.constraints.cold[i].max_elongation_ratio);
+        }
+        tiles.resize(solver.objects.size());
+        return true;
+    }
+
+    // Lines of the given level of detail, sorted by tile
+    const LinkTiles::Batch& getLevel(uint32_t level)
+    {
+        LinkTiles::Batch& batch = lods[level];
+        if (lods_versions[level] == mesh.topology_version) {
+            return batch;
+        }
+        lods_versions[level] = mesh.topology_version;
+        if (level == 0) {
+            tiles.sort(mesh.indices, batch);
+            return batch;
+        }
+        // Keep every 2^level rows and columns of the grid
+        const uint32_t step = 1 << level;
+        const uint64_t links_count = solver.constraints.size();
+        lod_lines.clear();
+        for (uint64_t i = 0; i < links_count; ++i) {
+            const LinkConstraint& link = solver.constraints.data[i];
+            const uint32_t id_1 = std::min(link.particle_1.getID(), link.particle_2.getID());
+            const uint32_t id_2 = std::max(link.particle_1.getID(), link.particle_2.getID());
+            bool keep;
+            if (grid_width && id_2 - id_1 == 1) {
+                keep = (id_1 / grid_width) % step == 0;
+            } else if (grid_width && id_2 - id_1 == grid_width) {
+                keep = (id_1 % grid_width) % step == 0;
+            } else {
+                keep = i % step == 0;
+            }
+            if (keep) {
+                lod_lines.push_back(mesh.indices[2 * i]);
+                lod_lines.push_back(mesh.indices[2 * i + 1]);
+            }
+        }
+        tiles.sort(lod_lines, batch);
+        return batch;
+    }
+
+    uint32_t getLevelOfDetail(float zoom) const
+    {
+        uint32_t level = 0;
+        if (level_of_detail) {
+            const float link_pixels = max_link_length * zoom;
+            while (level < LOD_MAX_LEVEL && link_pixels * to<float>(1 << level) < LOD_MIN_LINK_PIXELS) {
+                ++level;
+            }
+        }
+        return level;
+    }
+
+    void updateVisibleLines(const ViewportHandler::State& state)
+    {
+        const uint32_t level = getLevelOfDetail(state.zoom);
+        const LinkTiles::Batch& batch = getLevel(level);
+        indexed_lines.indices = &batch.indices;
+        if (!index_buffers.empty()) {
+            // Indices only change with the topology, not at every frame
+            if (index_buffers_versions[level] != lods_versions[level]) {
+                index_buffers[level].update(batch.indices);
+                index_buffers_versions[level] = lods_versions[level];
+            }
+            indexed_lines.setIndexBuffer(&index_buffers[level]);
+        }
+        if (culling) {
+            const sf::Vector2f half_size = state.center / state.zoom;
+            tiles.getVisibleRanges(batch, state.offset - half_size, state.offset + half_size, ranges);
+            indexed_lines.ranges = &ranges;
+        } else {
+            indexed_lines.ranges = nullptr;
+        }
+    }
+
+    // Refreshes the vertices and uploads them, unless nothing changed
+    void updateVertices()
+    {
+        PROFILE_SCOPE("update vertices");
+        const bool topology_changed = updateIndices();
+        pending_motion += solver.motion;
+        if (!topology_changed && !colors_dirty && pending_motion < RENDER_MOTION_THRESHOLD) {
+            return;
+        }
+        // Particles data indices change along with the topology
+        if (topology_changed || colors_dirty) {
+            mesh.updateColors(solver);
+            colors_dirty = false;
+        }
+        mesh.updatePositions(solver);
+        tiles.updateBounds(mesh.vertices);
+        pending_motion = 0.0f;
+        const uint64_t particles_count = mesh.vertices.size();
+        if (indexed_lines.buffer && particles_count) {
+            if (vertex_buffer.getVertexCount() < particles_count) {
+                vertex_buffer.create(particles_count);
+            }
+            vertex_buffer.update(mesh.vertices.data(), particles_count, 0);
+        }
+    }
+
     void render(RenderContext& context)
     {
-        updateVA();
-        context.draw(va);
+        PROFILE_SCOPE("render");
+        if (!buffer_checked) {
+            buffer_checked = true;
+            if (sf::VertexBuffer::isAvailable()) {
+                indexed_lines.setBuffer(&vertex_buffer);
+            }
+            if (IndexBuffer::isAvailable()) {
+                index_buffers = std::vector<IndexBuffer>(LOD_MAX_LEVEL + 1);
+                index_buffers_versions.assign(LOD_MAX_LEVEL + 1, solver.topology_version - 1);
+            }
+        }
+        // Vertices are shared by links in indexed mode, per link colors need lines
+        if (rm == RenderMode::Indexed && cm == ColorMode::Default) {
+            updateVertices();
+            updateVisibleLines(context.getState());
+            PROFILE_SCOPE("draw");
+            context.draw(indexed_lines);
+        } else {
+            updateVA();
+            PROFILE_SCOPE("draw");
+            context.draw(va);
+        }
     }
 };
 
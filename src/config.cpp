@@ -1,9 +1,30 @@
 /* Source file implementing include/config.hpp */
 
+#include <cctype>
+
 #include "config.hpp"
 
 using Status = config::Status;
 
+/* Frame paths are printf patterns given the frame number: exactly one %d, %u
+ * or zero padded %0Nd / %0Nu conversion, any other % must be written %% */
+static bool isFramePattern(const std::string& pattern)
+{
+    uint32_t conversions = 0;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] != '%') { continue; }
+        ++i;
+        if (i < pattern.size() && pattern[i] == '%') { continue; }
+        if (i < pattern.size() && pattern[i] == '0') { ++i; }
+        while (i < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[i]))) { ++i; }
+        if (i == pattern.size() || (pattern[i] != 'd' && pattern[i] != 'u')) {
+            return false;
+        }
+        ++conversions;
+    }
+    return conversions == 1;
+}
+
 /* Parse command-line arguments and return a status; 0 = success */
 Status config::parseCommandLineArguments(int argc, char* argv[])
 {
@@ -15,7 +36,10 @@ Status config::parseCommandLineArguments(int argc, char* argv[])
         ("wsize", po::value<uint32_t>()->default_value(WINDOW_WIDTH_DEFAULT),
         "window width in pixels")
         ("hsize", po::value<uint32_t>()->default_value(WINDOW_HEIGHT_DEFAULT),
-        "window height in pixels");
+        "window height in pixels")
+        ("lines", "draw two vertices per link instead of indexed particles")
+        ("noculling", "draw off-screen links too")
+        ("nolod", "always draw every link, even when zoomed out");
     po::options_description phys_opts("physics options");
     phys_opts.add_options()
         ("width,W", po::value<uint32_t>()->default_value(CLOTH_WIDTH_DEFAULT),
@@ -31,12 +55,58 @@ Status config::parseCommandLineArguments(int argc, char* argv[])
         ("friction,f", po::value<float>()->default_value(FRICTION_DEFAULT),
         "friction coefficient")
         ("nowind,N", "disable wind")
+        ("integrator", po::value<std::string>()->default_value(getIntegratorName(Integrator::SemiImplicitEuler)),
+        "integration scheme, euler or verlet")
+        ("solver", po::value<std::string>()->default_value(getConstraintSolverName(ConstraintSolver::PBD)),
+        "constraint solver, pbd, xpbd or pd")
+        ("stiffness", po::value<float>(),
+        "links stiffness with the xpbd and pd solvers, inextensible by default")
+        ("warm-start", po::value<float>()->default_value(WARM_START_DEFAULT),
+        "share of the previous sub-step multipliers the xpbd solver starts from, in [0, 1]")
+        ("shear", po::value<float>()->default_value(0.0f),
+        "stiffness of the diagonal links in [0, 1] with the pbd solver, 0 for none")
+        ("bend", po::value<float>()->default_value(0.0f),
+        "stiffness of the skip-one links in [0, 1] with the pbd solver, 0 for none")
+        ("substeps", po::value<uint32_t>()->default_value(SUB_STEPS_DEFAULT),
+        "physics sub-steps per frame")
+        ("iterations", po::value<uint32_t>()->default_value(SOLVER_ITERATIONS_DEFAULT),
+        "constraint solver iterations per sub-step")
+        ("attachments", "attach the particles to the nearest pinned ones, with the pbd and xpbd solvers")
+        ("multigrid", po::value<uint32_t>()->default_value(0),
+        "coarse levels of the multigrid pass with the pbd and xpbd solvers, 0 to disable")
+        ("chebyshev", "accelerate the iterations of the pbd solver, from 3 iterations")
         ("zoom,Z", po::value<float>()->default_value(BASE_ZOOM_DEFAULT),
         "initial zoom amount")
         ("defpath,P", po::value<std::string>(),
         "path to optional cloth definition JSON file")
         ;
+    po::options_description mem_opts("memory options");
+    mem_opts.add_options()
+        ("arena", "allocate the solver arrays from a single aligned arena")
+        ("hugepages", "back the arena with transparent huge pages (implies --arena)")
+        ;
+    po::options_description headless_opts("headless options");
+    headless_opts.add_options()
+        ("headless", "run without a window, rendering with the CPU rasterizer")
+        ("frames", po::value<uint32_t>()->default_value(HEADLESS_FRAMES_DEFAULT),
+        "number of frames simulated in headless mode")
+        ("capture", po::value<std::string>(),
+        "path of the captured frames with one %d, %u or %0Nd for the frame number and %% for %, "
+        "e.g. frame_%04d.ppm (implies --headless)")
+        ("threads", po::value<uint32_t>()->default_value(0),
+        "solver and rasterizer threads, 0 for one per core")
+        ;
+    po::options_description prof_opts("profiling options");
+    prof_opts.add_options()
+        ("trace", po::value<std::string>(),
+        "write a Chrome trace-event JSON file on exit and on T key press (CLOTH_PROFILER builds)")
+        ("perf", "report hardware counters per solver phase on exit, the solver then runs on the main thread "
+        "only (CLOTH_PERF_COUNTERS builds)")
+        ;
     opts.add(phys_opts);
+    opts.add(mem_opts);
+    opts.add(headless_opts);
+    opts.add(prof_opts);
     try {
         po::variables_map vm;
         po::store(po::parse_command_line(argc, argv, opts), vm);
@@ -47,13 +117,19 @@ Status config::parseCommandLineArguments(int argc, char* argv[])
             std::cerr << "\nkeyboard controls:"
                 << "\n  " << std::left << std::setw(16) << "Escape" << "close program"
                 << "\n  " << std::left << std::setw(16) << "Space" << "toggle wind"
+                << "\n  " << std::left << std::setw(16) << "G" << "toggle links strain coloring"
                 << "\n  " << std::left << std::setw(16) << "/" << "output viewport state"
+                << "\n  " << std::left << std::setw(16) << "P" << "output profiler zones (CLOTH_PROFILER builds)"
+                << "\n  " << std::left << std::setw(16) << "T" << "write the trace file (with --trace)"
                 << std::endl;
             status = config::Status::EXIT;
         }
         debug = vm.count("verbose") > 0;
         window_width = vm["wsize"].as<uint32_t>();
         window_height = vm["hsize"].as<uint32_t>();
+        render_lines = vm.count("lines") > 0;
+        culling = vm.count("noculling") == 0;
+        level_of_detail = vm.count("nolod") == 0;
         cloth_width = vm["width"].as<uint32_t>();
         cloth_height = vm["height"].as<uint32_t>();
         links_length = vm["linksize"].as<float>();
@@ -61,7 +137,75 @@ Status config::parseCommandLineArguments(int argc, char* argv[])
         gravity_y = vm["gy"].as<float>();
         friction_coef = vm["friction"].as<float>();
         disable_default_wind = vm.count("nowind") > 0;
+        if (!parseIntegrator(vm["integrator"].as<std::string>(), integrator)) {
+            throw po::validation_error(po::validation_error::invalid_option_value, "integrator");
+        }
+        if (!parseConstraintSolver(vm["solver"].as<std::string>(), constraint_solver)) {
+            throw po::validation_error(po::validation_error::invalid_option_value, "solver");
+        }
+        if (vm.count("stiffness") > 0) {
+            if (vm["stiffness"].as<float>() <= 0.0f) {
+                throw po::validation_error(po::validation_error::invalid_option_value, "stiffness");
+            }
+            compliance = 1.0f / vm["stiffness"].as<float>();
+        }
+        warm_start = vm["warm-start"].as<float>();
+        if (warm_start < 0.0f || warm_start > 1.0f) {
+            throw po::validation_error(po::validation_error::invalid_option_value, "warm-start");
+        }
+        shear_stiffness = vm["shear"].as<float>();
+        if (shear_stiffness < 0.0f || shear_stiffness > 1.0f) {
+            throw po::validation_error(po::validation_error::invalid_option_value, "shear");
+        }
+        bend_stiffness = vm["bend"].as<float>();
+        if (bend_stiffness < 0.0f || bend_stiffness > 1.0f) {
+            throw po::validation_error(po::validation_error::invalid_option_value, "bend");
+        }
+        // Only the pbd kernel solves the shear and bend links
+        if (constraint_solver != ConstraintSolver::PBD) {
+            if (shear_stiffness > 0.0f) {
+                throw po::validation_error(po::validation_error::invalid_option_value, "shear");
+            }
+            if (bend_stiffness > 0.0f) {
+                throw po::validation_error(po::validation_error::invalid_option_value, "bend");
+            }
+        }
+        sub_steps = vm["substeps"].as<uint32_t>();
+        solver_iterations = vm["iterations"].as<uint32_t>();
+        long_range_attachments = vm.count("attachments") > 0;
+        multigrid_levels = vm["multigrid"].as<uint32_t>();
+        chebyshev = vm.count("chebyshev") > 0;
+        if (sub_steps == 0) {
+            throw po::validation_error(po::validation_error::invalid_option_value, "substeps");
+        }
         initial_zoom = vm["zoom"].as<float>();
+        huge_pages = vm.count("hugepages") > 0;
+        use_arena = vm.count("arena") > 0 || huge_pages;
+        if (vm.count("capture") > 0) {
+            capture_path = vm["capture"].as<std::string>();
+            if (!isFramePattern(capture_path)) {
+                throw po::validation_error(po::validation_error::invalid_option_value, "capture");
+            }
+        }
+        headless = vm.count("headless") > 0 || !capture_path.empty();
+        frames_count = vm["frames"].as<uint32_t>();
+        if (vm.count("trace") > 0) {
+            trace_path = vm["trace"].as<std::string>();
+#ifndef CLOTH_PROFILER
+            std::cerr << "warning: --trace needs a build with CLOTH_PROFILER enabled" << std::endl;
+            // Nothing is recorded, so no trace is written either
+            trace_path.clear();
+#endif
+        }
+        perf_counters = vm.count("perf") > 0;
+#ifndef CLOTH_PERF_COUNTERS
+        if (perf_counters) {
+            std::cerr << "warning: --perf needs a build with CLOTH_PERF_COUNTERS enabled" << std::endl;
+            // Nothing is counted, the solver can keep its threads
+            perf_counters = false;
+        }
+#endif
+        threads_count = vm["threads"].as<uint32_t>();
         if (vm.count("defpath") > 0) {
             cloth_definition_path = vm["defpath"].as<std::string>();
             if (cloth_definition_path.length() > 0) {
@@ -120,36 +264,100 @@ Status config::parseConfigurationFile(const std::string& fpath)
 void config::buildCloth(PhysicSolver& solver) const
 {
     const float start_x = (window_width - (cloth_width - 1) * links_length) * 0.5;
-    for (uint32_t y = 0; y < cloth_height; ++y) {
-        const float max_elongation = 1.2f * (2.0f - y / float(cloth_height));
-        for (uint32_t x = 0; x < cloth_width; ++x) {
-            const auto ppos = sf::Vector2f(start_x + x * links_length, y * links_length);
-            const civ::ID id = solver.addParticle(ppos);
-            if (x > 0) {
-                solver.addLink(id-1, id, max_elongation * 0.9f);
-            }
-            if (y > 0) {
-                solver.addLink(id-cloth_width, id, max_elongation);
-            } else {
-                solver.objects[id].moving = false;
-            }
+    ClothBuilder builder(cloth_width, cloth_height, links_length, Vec2(start_x, 0.0f));
+    builder.shear_stiffness = shear_stiffness;
+    builder.bend_stiffness = bend_stiffness;
+    if (use_arena) {
+        const uint64_t links_count = solver.constraints.size() + solver.shear_links.links.size()
+                                   + solver.bend_links.links.size() + builder.getAllLinksCount();
+        const uint64_t size = PhysicSolver::getStorageSize(
+            solver.objects.size() + builder.getParticlesCount(), links_count);
+        solver.useArena(size, huge_pages);
+    }
+    // Reuse the solver pool, sized by --threads, rather than a temporary one
+    if (solver.thread_pool) {
+        builder.build(solver, *solver.thread_pool);
+    } else {
+        builder.build(solver);
+    }
+}
+
+void config::buildWind(WindManager& wind) const
+{
+    if (winds.size() == 0) {
+        if (!disable_default_wind) {
+            // Add 2 wind waves
+            wind.winds.emplace_back(
+                Vec2(100.0f, to<float>(window_height)),
+                Vec2(0.0f, 0.0f),
+                Vec2(1000.0f, 0.0f)
+            );
+            wind.winds.emplace_back(
+                Vec2(20.0f, to<float>(window_height)),
+                Vec2(0.0f, 0.0f),
+                Vec2(3000.0f, 0.0f)
+            );
+        }
+    } else {
+        for (const Wind& w : winds) {
+            wind.winds.push_back(w);
         }
     }
 }
 
+void config::setupSolver(PhysicSolver& solver) const
+{
+    solver.kernel_config.integrator = integrator;
+    solver.kernel_config.constraint_solver = constraint_solver;
+    solver.sub_steps = sub_steps;
+    solver.solver_iterations = solver_iterations;
+    solver.setCompliance(compliance);
+    solver.warm_start = warm_start;
+    solver.long_range.enabled = long_range_attachments;
+    solver.multigrid.levels = multigrid_levels;
+    solver.chebyshev.enabled = chebyshev;
+    solver.kernel_config.wind = !winds.empty() || !disable_default_wind;
+    solver.updateKernel();
+}
+
 void config::print(std::ostream& os) const
 {
     os << "configuration:" << "\n"
        << "verbose: " << debug << "\n"
        << "window size: " << window_width << " by " << window_height << "\n"
+       << "render mode: " << (render_lines ? "lines" : "indexed") << "\n"
+       << "culling: " << (culling ? "enabled" : "disabled") << "\n"
+       << "level of detail: " << (level_of_detail ? "enabled" : "disabled") << "\n"
        << "cloth size: " << cloth_width << " by " << cloth_height << "\n"
        << "link length: " << links_length << "\n"
        << "gravity vector: " << gravity_x << "," << gravity_y << "\n"
        << "friction coefficient: " << friction_coef << "\n"
+       << "integrator: " << getIntegratorName(integrator) << "\n"
+       << "constraint solver: " << getConstraintSolverName(constraint_solver) << "\n"
+       << "links stiffness: ";
+    if (compliance > 0.0f) {
+        os << 1.0f / compliance << "\n";
+    } else {
+        os << "inextensible\n";
+    }
+    os << "xpbd warm start: " << warm_start << "\n"
+       << "shear links stiffness: " << shear_stiffness << "\n"
+       << "bend links stiffness: " << bend_stiffness << "\n"
+       << "sub-steps: " << sub_steps << "\n"
+       << "solver iterations: " << solver_iterations << "\n"
+       << "long range attachments: " << (long_range_attachments ? "enabled" : "disabled") << "\n"
+       << "multigrid levels: " << multigrid_levels << "\n"
+       << "chebyshev acceleration: " << (chebyshev ? "enabled" : "disabled") << "\n"
        << "default wind: " << (disable_default_wind ? "disabled" : "enabled") << "\n"
        << "mouse erase radius: " << erase_radius << "\n"
        << "mouse drag radius: " << mouse_drag_radius << "\n"
        << "mouse drag force: " << mouse_drag_force << "\n"
+       << "headless: " << (headless ? "enabled" : "disabled") << "\n"
+       << "headless frames: " << frames_count << "\n"
+       << "capture path: " << capture_path << "\n"
+       << "trace path: " << trace_path << "\n"
+       << "hardware counters: " << (perf_counters ? "enabled" : "disabled") << "\n"
+       << "solver storage: " << (use_arena ? (huge_pages ? "arena (huge pages)" : "arena") : "heap") << "\n"
        << "cloth definition file: " << cloth_definition_path << "\n";
     for (uint32_t i = 0; i < winds.size(); ++i) {
         const Wind& wind = winds[i];
@@ -180,6 +388,61 @@ Status config::interpretJSON(const json& jobj)
         gravity_x = gravity.x;
         gravity_y = gravity.y;
     }
+    if (jobj.contains("integrator")) {
+        const std::string name = jobj["integrator"];
+        if (!parseIntegrator(name, integrator)) {
+            throw std::logic_error("Unknown integrator " + name);
+        }
+    }
+    if (jobj.contains("solver")) {
+        const std::string name = jobj["solver"];
+        if (!parseConstraintSolver(name, constraint_solver)) {
+            throw std::logic_error("Unknown solver " + name);
+        }
+    }
+    if (jobj.contains("stiffness")) {
+        const float stiffness = jobj["stiffness"];
+        if (stiffness <= 0.0f) {
+            throw std::logic_error("Stiffness must be positive");
+        }
+        compliance = 1.0f / stiffness;
+    }
+    if (jobj.contains("warm_start")) {
+        warm_start = jobj["warm_start"];
+        if (warm_start < 0.0f || warm_start > 1.0f) {
+            throw std::logic_error("Warm start must be between 0 and 1");
+        }
+    }
+    if (jobj.contains("shear")) {
+        shear_stiffness = jobj["shear"];
+        if (shear_stiffness < 0.0f || shear_stiffness > 1.0f) {
+            throw std::logic_error("Shear stiffness must be between 0 and 1");
+        }
+    }
+    if (jobj.contains("bend")) {
+        bend_stiffness = jobj["bend"];
+        if (bend_stiffness < 0.0f || bend_stiffness > 1.0f) {
+            throw std::logic_error("Bend stiffness must be between 0 and 1");
+        }
+    }
+    if (jobj.contains("substeps")) {
+        sub_steps = jobj["substeps"];
+        if (sub_steps == 0) {
+            throw std::logic_error("At least one sub-step is needed");
+        }
+    }
+    if (jobj.contains("iterations")) {
+        solver_iterations = jobj["iterations"];
+    }
+    if (jobj.contains("attachments")) {
+        long_range_attachments = jobj["attachments"];
+    }
+    if (jobj.contains("multigrid")) {
+        multigrid_levels = jobj["multigrid"];
+    }
+    if (jobj.contains("chebyshev")) {
+        chebyshev = jobj["chebyshev"];
+    }
     if (jobj.contains("wind")) {
         for (auto item : jobj["wind"]) {
             if (!item.is_array() || item.size() != 3) {
@@ -188,9 +451,12 @@ Status config::interpretJSON(const json& jobj)
             const sf::Vector2f wind_s = interpretVec2JSON<float>(item.at(0), 0.0f, to<float>(window_height));
             const sf::Vector2f wind_p = interpretVec2JSON<float>(item.at(1), 0.0f, 0.0f);
             const sf::Vector2f wind_f = interpretVec2JSON<float>(item.at(2));
-            winds.emplace_back(wind_s, wind_p, wind_f);
+            winds.emplace_back(toVec2(wind_s), toVec2(wind_p), toVec2(wind_f));
         }
     }
+    if (constraint_solver != ConstraintSolver::PBD && (shear_stiffness > 0.0f || bend_stiffness > 0.0f)) {
+        throw std::logic_error("Shear and bend links need the pbd solver");
+    }
     return Status::OK;
 }
 
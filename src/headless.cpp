@@ -0,0 +1,117 @@
+/* Source file implementing include/headless.hpp */
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+#include "headless.hpp"
+#include "cloth_mesh.hpp"
+#include "engine/common/frame_stats.hpp"
+#include "engine/common/thread_pool.hpp"
+#include "engine/render/software_rasterizer.hpp"
+
+// The pattern was checked by the configuration, see isFramePattern
+static std::string getFramePath(const std::string& pattern, uint32_t frame)
+{
+    const int length = std::snprintf(nullptr, 0, pattern.c_str(), frame);
+    if (length < 0) {
+        return pattern;
+    }
+    std::vector<char> path(to<size_t>(length) + 1);
+    std::snprintf(path.data(), path.size(), pattern.c_str(), frame);
+    return path.data();
+}
+
+int runHeadless(const config& conf)
+{
+    const uint32_t threads_count = conf.threads_count ? conf.threads_count : std::thread::hardware_concurrency();
+    tp::ThreadPool thread_pool(threads_count);
+
+    PhysicSolver solver(conf.gravity_x, conf.gravity_y, conf.friction_coef);
+    // Counters only follow the main thread, see main
+    if (!conf.perf_counters) {
+        solver.setThreadPool(&thread_pool);
+    }
+    conf.buildCloth(solver);
+    conf.setupSolver(solver);
+    WindManager wind(to<float>(conf.window_width));
+    conf.buildWind(wind);
+
+    // Same view as the window would have at startup
+    ViewportHandler viewport(sf::Vector2f(to<float>(conf.window_width), to<float>(conf.window_height)));
+    viewport.setZoom(conf.initial_zoom);
+
+    SoftwareRasterizer rasterizer(conf.window_width, conf.window_height, thread_pool);
+    ClothMesh mesh(solver);
+
+    // Frames are written by a dedicated thread while the next one is computed
+    tp::ThreadPool writer(1);
+    std::vector<sf::Color> pending_frame(rasterizer.pixels.size());
+    std::atomic<bool> write_failed(false);
+    const bool capture = !conf.capture_path.empty();
+
+    FrameStats frame_stats;
+    double write_ms = 0.0;
+    const FrameClock::time_point run_start = FrameClock::now();
+    const float dt = 1.0f / 60.0f;
+    for (uint32_t frame(0); frame < conf.frames_count && !write_failed; ++frame) {
+        PROFILE_FRAME();
+        PROFILE_SCOPE("frame");
+        const FrameClock::time_point frame_start = FrameClock::now();
+        wind.update(solver, dt);
+        solver.update(dt);
+        const float physics_ms = getElapsedMs(frame_start);
+
+        const FrameClock::time_point render_start = FrameClock::now();
+        {
+            PROFILE_SCOPE("render");
+            // Particles data indices change along with the topology
+            if (mesh.updateIndices(solver)) {
+                mesh.updateColors(solver);
+            }
+            mesh.updatePositions(solver);
+            rasterizer.clear();
+            rasterizer.draw(mesh.vertices, mesh.indices, viewport.getTransform());
+        }
+        const float render_ms = getElapsedMs(render_start);
+
+        if (capture) {
+            const FrameClock::time_point write_start = FrameClock::now();
+            {
+                PROFILE_SCOPE("wait for writer");
+                writer.waitForCompletion();
+            }
+            write_ms += getElapsedMs(write_start);
+            std::swap(pending_frame, rasterizer.pixels);
+            writer.addTask([&, path = getFramePath(conf.capture_path, frame)] {
+                if (!SoftwareRasterizer::saveToFile(path, rasterizer.width, rasterizer.height, pending_frame)) {
+                    std::cerr << "Failed writing " << path << std::endl;
+                    write_failed = true;
+                }
+            });
+        }
+        frame_stats.addFrame(physics_ms, render_ms, getElapsedMs(frame_start));
+        if (conf.debug && frame_stats.frames_count % FRAME_STATS_WINDOW == 0) {
+            frame_stats.printWindow(std::cerr);
+        }
+    }
+    writer.waitForCompletion();
+    const float run_ms = getElapsedMs(run_start);
+    PROFILE_PRINT(std::cerr);
+    if (!conf.trace_path.empty() && !PROFILE_WRITE_TRACE(conf.trace_path)) {
+        std::cerr << "Failed writing trace to " << conf.trace_path << std::endl;
+    }
+
+    const double frames = std::max(1u, conf.frames_count);
+    std::cerr << "headless: " << conf.frames_count << " frames at "
+        << conf.window_width << "x" << conf.window_height << " on " << thread_pool.thread_count << " threads, "
+        << frames * 1000.0 / run_ms << " fps, "
+        << write_ms / frames << " ms/frame waiting for writer"
+        << std::endl;
+    frame_stats.printRun(std::cerr);
+    PERF_PRINT(std::cerr);
+
+    return write_failed ? 1 : 0;
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -1,4 +1,7 @@
 #include "config.hpp"
+#include "headless.hpp"
+#include "engine/common/frame_stats.hpp"
+#include "engine/common/thread_pool.hpp"
 
 /* TODO: Command-line and configuration handling
  *  initial focus (RenderContext::setFocus(sf::Vector2f focus))
@@ -19,6 +22,8 @@ bool isInRadius(const Particle& p, sf::Vector2f center, float radius);
 
 void applyForceOnCloth(sf::Vector2f position, float radius, sf::Vector2f force, PhysicSolver& solver);
 
+void writeTrace(const std::string& path);
+
 int main(int argc, char* argv[])
 {
     config conf = config();
@@ -35,13 +40,41 @@ int main(int argc, char* argv[])
         conf.print(std::cerr);
     }
 
+    PROFILE_THREAD_NAME("main");
+    if (!conf.trace_path.empty()) {
+        PROFILE_ENABLE_TRACING();
+    }
+    // Counters only follow the thread opening them, the solver then stays on this one
+    if (conf.perf_counters && !PERF_OPEN(std::cerr)) {
+        std::cerr << "Hardware counters unavailable, continuing without them" << std::endl;
+    }
+
+    if (conf.headless) {
+        return runHeadless(conf);
+    }
+
     const sf::Vector2u window_size(conf.window_width, conf.window_height);
     WindowContextHandler app("Cloth", window_size, sf::Style::Default);
 
+    // Shares the particle passes of large cloths between threads
+    const uint32_t threads_count = conf.threads_count ? conf.threads_count : std::thread::hardware_concurrency();
+    tp::ThreadPool thread_pool(threads_count);
+
     PhysicSolver solver(conf.gravity_x, conf.gravity_y, conf.friction_coef);
+    if (!conf.perf_counters) {
+        solver.setThreadPool(&thread_pool);
+    }
     Renderer renderer(solver);
+    renderer.setRenderMode(conf.render_lines ? RenderMode::Lines : RenderMode::Indexed);
+    renderer.setCulling(conf.culling);
+    renderer.setLevelOfDetail(conf.level_of_detail);
+    renderer.setGridWidth(conf.cloth_width);
 
     conf.buildCloth(solver);
+    conf.setupSolver(solver);
+    if (conf.debug) {
+        std::cerr << "solver kernel: " << solver.kernel->getName() << std::endl;
+    }
 
     app.getRenderContext().setZoom(conf.initial_zoom);
 
@@ -68,6 +101,19 @@ int main(int argc, char* argv[])
         wind_blowing = !wind_blowing;
         std::cerr << "Wind is " << (wind_blowing ? "now" : "no longer") << " blowing" << std::endl;
     });
+    app.getEventManager().addKeyPressedCallback(sf::Keyboard::Key::G, [&](sfev::CstEv) {
+        const bool gradient = renderer.cm != ColorMode::Gradient;
+        renderer.setColorMode(gradient ? ColorMode::Gradient : ColorMode::Default);
+        std::cerr << "Links are " << (gradient ? "now" : "no longer") << " colored by strain" << std::endl;
+    });
+    app.getEventManager().addKeyPressedCallback(sf::Keyboard::Key::P, [&](sfev::CstEv) {
+        PROFILE_PRINT(std::cerr);
+    });
+    app.getEventManager().addKeyPressedCallback(sf::Keyboard::Key::T, [&](sfev::CstEv) {
+        if (!conf.trace_path.empty()) {
+            writeTrace(conf.trace_path);
+        }
+    });
     app.getEventManager().addKeyPressedCallback(sf::Keyboard::Key::Slash, [&](sfev::CstEv) {
         ViewportHandler::State vstate = app.getRenderContext().getState();
         std::cerr << "current viewport state:"
@@ -84,33 +130,21 @@ int main(int argc, char* argv[])
     */
 
     WindManager wind(to<float>(conf.window_width));
-    if (conf.winds.size() == 0) {
-        if (!conf.disable_default_wind) {
-            // Add 2 wind waves
-            wind.winds.emplace_back(
-                sf::Vector2f(100.0f, conf.window_height),
-                sf::Vector2f(0.0f, 0.0f),
-                sf::Vector2f(1000.0f, 0.0f)
-            );
-            wind.winds.emplace_back(
-                sf::Vector2f(20.0f, conf.window_height),
-                sf::Vector2f(0.0f, 0.0f),
-                sf::Vector2f(3000.0f, 0.0f)
-            );
-        }
-    } else {
-        for (const Wind& w : conf.winds) {
-            wind.winds.push_back(w);
-        }
-    }
+    conf.buildWind(wind);
 
     // Main loop
     const float dt = 1.0f / 60.0f;
+    FrameStats frame_stats;
+    FrameClock::time_point frame_start = FrameClock::now();
     while (app.run()) {
+        PROFILE_FRAME();
+        PROFILE_SCOPE("frame");
+        const FrameClock::time_point physics_start = FrameClock::now();
         // Get the mouse coord in the world space, to allow proper control even with modified viewport
         const sf::Vector2f mouse_position = app.getWorldMousePosition();
 
         if (dragging) {
+            PROFILE_SCOPE("drag tool");
             // Apply a force on the particles in the direction of the mouse's movement
             const sf::Vector2f mouse_speed = mouse_position - last_mouse_position;
             const sf::Vector2f mouse_force = mouse_speed * conf.mouse_drag_force;
@@ -119,10 +153,13 @@ int main(int argc, char* argv[])
         }
 
         if (erasing) {
-            // Delete all nodes that are in the range of the mouse
-            for (Particle& p : solver.objects) {
+            PROFILE_SCOPE("erase tool");
+            // Delete all nodes that are in the range of the mouse, backward
+            // since erasing swaps the last particle in place
+            for (uint64_t i(solver.objects.size()); i--;) {
+                const Particle& p = solver.objects.data[i];
                 if (isInRadius(p, mouse_position, conf.erase_radius)) {
-                    solver.objects.erase(p.id);
+                    solver.eraseParticle(p.id);
                 }
             }
         }
@@ -131,29 +168,60 @@ int main(int argc, char* argv[])
             wind.update(solver, dt);
         }
         solver.update(dt);
+        const float physics_ms = getElapsedMs(physics_start);
         // Render the scene
+        const FrameClock::time_point render_start = FrameClock::now();
         RenderContext& render_context = app.getRenderContext();
         render_context.clear();
         renderer.render(render_context);
-        render_context.display();
+        {
+            PROFILE_SCOPE("display");
+            render_context.display();
+        }
+        const float render_ms = getElapsedMs(render_start);
+        // Frame to frame, including events handling and waiting for the display
+        frame_stats.addFrame(physics_ms, render_ms, getElapsedMs(frame_start));
+        frame_start = FrameClock::now();
+        if (conf.debug && frame_stats.frames_count % FRAME_STATS_WINDOW == 0) {
+            frame_stats.printWindow(std::cerr);
+        }
     }
 
+    frame_stats.printRun(std::cerr);
+    PERF_PRINT(std::cerr);
+
+    PROFILE_PRINT(std::cerr);
+    if (!conf.trace_path.empty()) {
+        writeTrace(conf.trace_path);
+    }
     return 0;
 }
 
 bool isInRadius(const Particle& p, sf::Vector2f center, float radius)
 {
-    const sf::Vector2f v = center - p.position;
+    const Vec2 v = toVec2(center) - p.position;
     return v.x * v.x + v.y * v.y < radius * radius;
 }
 
 void applyForceOnCloth(sf::Vector2f position, float radius, sf::Vector2f force, PhysicSolver& solver)
 {
-    for (Particle& p : solver.objects) {
+    const Vec2 particle_force = toVec2(force);
+    // Pinned particles ignore forces
+    for (uint64_t i(solver.pinned_count); i < solver.objects.size(); ++i) {
+        Particle& p = solver.objects.data[i];
         if (isInRadius(p, position, radius)) {
-            p.forces += force;
+            p.forces += particle_force;
         }
     }
 }
 
+void writeTrace(const std::string& path)
+{
+    if (PROFILE_WRITE_TRACE(path)) {
+        std::cerr << "Wrote trace to " << path << std::endl;
+    } else {
+        std::cerr << "Failed writing trace to " << path << std::endl;
+    }
+}
+
 /* vim: set ts=4 sts=4 sw=4 et: */
@@ -0,0 +1,110 @@
+/* Source file implementing include/engine/physics/chebyshev.hpp */
+
+#include "engine/physics/chebyshev.hpp"
+#include "engine/physics/physics.hpp"
+
+void ChebyshevAcceleration::begin(PhysicSolver& solver)
+{
+    // Another cloth converges at another rate
+    if (topology_version != solver.topology_version) {
+        spectral_radius = 0.0f;
+        observed_radius = 0.0f;
+        radius_limit = CHEBYSHEV_MAX_SPECTRAL_RADIUS;
+        typical_correction = 0.0;
+        topology_version = solver.topology_version;
+    }
+    const Particle* const moving = solver.objects.data.data() + solver.pinned_count;
+    const uint64_t count = solver.objects.size() - solver.pinned_count;
+    previous.resize(count);
+    for (uint64_t i(0); i < count; ++i) {
+        previous[i] = moving[i].position;
+    }
+    last = previous;
+    sweep = 0;
+    omega = 1.0f;
+    accelerating = true;
+}
+
+void ChebyshevAcceleration::fallBack()
+{
+    accelerating = false;
+    omega = 1.0f;
+    spectral_radius *= CHEBYSHEV_FALLBACK_DAMPING;
+    observed_radius = spectral_radius;
+    ++fallbacks_count;
+}
+
+void ChebyshevAcceleration::observe(double last_correction)
+{
+    float radius;
+    if (sweep == 2) {
+        // No accelerated sweep, only the plain ratio
+        radius = to<float>(std::sqrt(second_correction / first_correction));
+    } else {
+        // Corrections are squared norms
+        const double q = std::pow(last_correction / second_correction, 0.5 / (sweep - 2));
+        const double r = spectral_radius;
+        const double a = q * (1.0 + std::sqrt(1.0 - r * r));
+        // Under the estimate the sweeps converge as fast as they can, which
+        // only says the radius is not above
+        radius = to<float>(a > r ? (a * a + r * r) / (2.0 * a) : a);
+    }
+    observed_radius += CHEBYSHEV_OBSERVATION_WEIGHT * (radius - observed_radius);
+    if (std::abs(observed_radius - spectral_radius) > CHEBYSHEV_HYSTERESIS) {
+        spectral_radius = std::min(radius_limit, observed_radius);
+    }
+}
+
+void ChebyshevAcceleration::step(PhysicSolver& solver)
+{
+    PROFILE_SCOPE("chebyshev");
+    Particle* const moving = solver.objects.data.data() + solver.pinned_count;
+    const uint64_t count = previous.size();
+    // Serial, so that the estimate does not depend on the threads count
+    double correction = 0.0;
+    for (uint64_t i(0); i < count; ++i) {
+        const Vec2 d = moving[i].position - last[i];
+        correction += d.x * d.x + d.y * d.y;
+    }
+    ++sweep;
+    if (sweep == 1) {
+        first_correction = correction;
+        // Energy added by the extrapolation shows up as larger corrections
+        // from one sub-step to the next
+        if (typical_correction > 0.0 && correction > CHEBYSHEV_DIVERGENCE_RATIO * typical_correction) {
+            fallBack();
+        }
+        if (typical_correction > 0.0) {
+            typical_correction += CHEBYSHEV_TYPICAL_WEIGHT * (correction - typical_correction);
+        } else {
+            typical_correction = correction;
+        }
+    } else if (sweep == 2) {
+        second_correction = correction;
+        if (spectral_radius == 0.0f && first_correction > 0.0) {
+            spectral_radius = std::min(CHEBYSHEV_MAX_SPECTRAL_RADIUS,
+                                       to<float>(std::sqrt(correction / first_correction)));
+            observed_radius = spectral_radius;
+        }
+        omega = accelerating ? 2.0f / (2.0f - spectral_radius * spectral_radius) : 1.0f;
+    } else if (accelerating && correction > first_correction) {
+        // The corrections of an accelerated sub-step do not decrease
+        // monotonically, but they never exceed the first one unless diverging.
+        // The observations can overestimate the radius, this one is too high
+        radius_limit = std::max(0.0f, spectral_radius - CHEBYSHEV_HYSTERESIS);
+        fallBack();
+    } else if (accelerating) {
+        omega = 4.0f / (4.0f - spectral_radius * spectral_radius * omega);
+    }
+    if (accelerating && sweep + 1 == solver.solver_iterations && first_correction > 0.0 && second_correction > 0.0) {
+        observe(correction);
+    }
+    for (uint64_t i(0); i < count; ++i) {
+        const Vec2 position = (moving[i].position - previous[i]) * omega + previous[i];
+        moving[i].position = position;
+        previous[i] = last[i];
+        last[i] = position;
+    }
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -0,0 +1,91 @@
+/* Source file implementing include/engine/physics/long_range.hpp */
+
+#include <functional>
+#include <limits>
+#include <queue>
+
+#include "engine/physics/link_graph.hpp"
+#include "engine/physics/long_range.hpp"
+#include "engine/physics/physics.hpp"
+
+void LongRangeAttachments::solve(PhysicSolver& solver)
+{
+    if (!enabled) { return; }
+    update(solver);
+    PROFILE_SCOPE("long range");
+    Particle* const particles = solver.objects.data.data();
+    Particle* const moving = particles + solver.pinned_count;
+    solver.parallelFor(anchors.size(), [&](uint64_t start, uint64_t end) {
+        for (uint64_t i(start); i < end; ++i) {
+            const uint32_t anchor = anchors[i];
+            if (anchor == NO_ANCHOR) { continue; }
+            Particle& p = moving[i];
+            const Vec2 v = p.position - particles[anchor].position;
+            const float dist = v.getLength();
+            if (dist > distances[i]) {
+                p.move(v * (distances[i] / dist - 1.0f));
+            }
+        }
+    });
+}
+
+void LongRangeAttachments::update(PhysicSolver& solver)
+{
+    if (particles_version != solver.particles_version) {
+        search(solver);
+        return;
+    }
+    if (topology_version == solver.topology_version) { return; }
+    // Links were added or erased, the distances only change if a path broke
+    for (uint64_t i(0); i < anchors.size(); ++i) {
+        if (anchors[i] != NO_ANCHOR && !solver.constraints.isValid(path_links[i])) {
+            search(solver);
+            return;
+        }
+    }
+    topology_version = solver.topology_version;
+}
+
+void LongRangeAttachments::search(PhysicSolver& solver)
+{
+    PROFILE_SCOPE("long range search");
+    const uint64_t count = solver.objects.size();
+    const uint64_t first = solver.pinned_count;
+    LinkGraph graph;
+    graph.build(count, LinkGraph::getLinks(solver.objects, solver.constraints));
+
+    // Multi-source Dijkstra, every pinned particle is its own anchor
+    std::vector<float> graph_distances(count, std::numeric_limits<float>::infinity());
+    std::vector<uint32_t> nearest(count, NO_ANCHOR);
+    std::vector<civ::CompactHandle> previous_links(count);
+    using Entry = std::pair<float, uint32_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    for (uint64_t i(0); i < first; ++i) {
+        graph_distances[i] = 0.0f;
+        nearest[i] = to<uint32_t>(i);
+        queue.emplace(0.0f, to<uint32_t>(i));
+    }
+    while (!queue.empty()) {
+        const auto [distance, node] = queue.top();
+        queue.pop();
+        if (distance > graph_distances[node]) { continue; }
+        for (const LinkGraph::Edge* e = graph.begin(node); e != graph.end(node); ++e) {
+            const float candidate = distance + e->length;
+            if (candidate < graph_distances[e->node]) {
+                graph_distances[e->node] = candidate;
+                nearest[e->node] = nearest[node];
+                previous_links[e->node] = solver.constraints.metadata[e->link];
+                queue.emplace(candidate, e->node);
+            }
+        }
+    }
+
+    anchors.assign(nearest.begin() + first, nearest.end());
+    distances.assign(graph_distances.begin() + first, graph_distances.end());
+    path_links.assign(previous_links.begin() + first, previous_links.end());
+    particles_version = solver.particles_version;
+    topology_version = solver.topology_version;
+    ++searches_count;
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -0,0 +1,187 @@
+/* Source file implementing include/engine/physics/multigrid.hpp */
+
+#include "engine/physics/multigrid.hpp"
+#include "engine/physics/physics.hpp"
+
+// Coarse links are only made along paths whose links are about collinear at
+// rest, the diagonals of a grid would never be taut
+const float MULTIGRID_STRAIGHTNESS = 0.99f;
+const uint32_t MULTIGRID_NO_NODE = 0xFFFFFFFF;
+
+void Multigrid::solve(PhysicSolver& solver)
+{
+    if (!levels) { return; }
+    update(solver);
+    PROFILE_SCOPE("multigrid");
+    Particle* const particles = solver.objects.data.data();
+    for (uint64_t l(hierarchy.size()); l--;) {
+        Level& level = hierarchy[l];
+        const uint8_t* const finer_alive = l ? hierarchy[l - 1].alive.data() : fine_alive.data();
+        Vec2* const displacements = level.displacements.data();
+        solver.parallelFor(level.nodes.size(), [&](uint64_t start, uint64_t end) {
+            for (uint64_t i(start); i < end; ++i) {
+                displacements[i] = particles[level.nodes[i]].position;
+            }
+        });
+        // Same correction as LinkConstraint::solve
+        for (uint64_t k(0); k < level.links.size(); ++k) {
+            if (!level.alive[k]) { continue; }
+            const LinkGraph::Link& link = level.links[k];
+            Particle& p_1 = particles[link.a];
+            Particle& p_2 = particles[link.b];
+            const Vec2 v = p_1.position - p_2.position;
+            const float dist = v.getLength();
+            const float w = p_1.inverse_mass + p_2.inverse_mass;
+            if (dist > link.length && w > 0.0f) {
+                const Vec2 p = v * ((link.length - dist) / (dist * w));
+                p_1.move(p * p_1.inverse_mass);
+                p_2.move(p * -p_2.inverse_mass);
+            }
+        }
+        solver.parallelFor(level.nodes.size(), [&](uint64_t start, uint64_t end) {
+            for (uint64_t i(start); i < end; ++i) {
+                displacements[i] = particles[level.nodes[i]].position - displacements[i];
+            }
+        });
+        // Pinned children have no inverse mass and stay in place, children
+        // torn from all their parents too
+        solver.parallelFor(level.children.size(), [&](uint64_t start, uint64_t end) {
+            for (uint64_t i(start); i < end; ++i) {
+                Vec2 displacement;
+                uint32_t count = 0;
+                for (uint32_t k(level.parent_offsets[i]); k < level.parent_offsets[i + 1]; ++k) {
+                    if (finer_alive[level.parent_links[k]]) {
+                        displacement += displacements[level.parents[k]];
+                        ++count;
+                    }
+                }
+                Particle& p = particles[level.children[i]];
+                if (count && p.inverse_mass > 0.0f) {
+                    p.move(displacement / to<float>(count));
+                }
+            }
+        });
+    }
+}
+
+void Multigrid::update(PhysicSolver& solver)
+{
+    if (particles_version != solver.particles_version || built_levels != levels) {
+        build(solver);
+        return;
+    }
+    if (topology_version == solver.topology_version) { return; }
+    topology_version = solver.topology_version;
+    bool erased = false;
+    for (uint64_t k(0); k < fine_links.size(); ++k) {
+        if (fine_alive[k] && !solver.constraints.isValid(fine_links[k])) {
+            fine_alive[k] = false;
+            erased = true;
+        }
+    }
+    if (!erased) { return; }
+    // A coarse link lives as long as both links it spans
+    const std::vector<uint8_t>* finer_alive = &fine_alive;
+    for (Level& level : hierarchy) {
+        for (uint64_t k(0); k < level.links.size(); ++k) {
+            level.alive[k] = (*finer_alive)[level.link_sources[k][0]] && (*finer_alive)[level.link_sources[k][1]];
+        }
+        finer_alive = &level.alive;
+    }
+}
+
+void Multigrid::build(PhysicSolver& solver)
+{
+    PROFILE_SCOPE("multigrid build");
+    hierarchy.clear();
+    // Nodes of the finer level, as data indices, and its links between indices into nodes
+    std::vector<uint32_t> nodes(solver.objects.size());
+    for (uint64_t i(0); i < nodes.size(); ++i) {
+        nodes[i] = to<uint32_t>(i);
+    }
+    std::vector<LinkGraph::Link> links = LinkGraph::getLinks(solver.objects, solver.constraints);
+    fine_links.assign(solver.constraints.metadata.begin(), solver.constraints.metadata.begin() + links.size());
+    fine_alive.assign(links.size(), true);
+    LinkGraph graph;
+    std::vector<uint32_t> coarse_index;
+    while (hierarchy.size() < levels) {
+        const uint64_t count = nodes.size();
+        graph.build(count, links);
+        Level level;
+        // Greedy maximal independent set
+        coarse_index.assign(count, MULTIGRID_NO_NODE);
+        for (uint64_t i(0); i < count; ++i) {
+            bool independent = true;
+            for (const LinkGraph::Edge* e = graph.begin(i); e != graph.end(i) && independent; ++e) {
+                independent = coarse_index[e->node] == MULTIGRID_NO_NODE;
+            }
+            if (independent) {
+                coarse_index[i] = to<uint32_t>(level.nodes.size());
+                level.nodes.push_back(nodes[i]);
+            }
+        }
+        level.parent_offsets.push_back(0);
+        for (uint64_t i(0); i < count; ++i) {
+            if (coarse_index[i] != MULTIGRID_NO_NODE) { continue; }
+            level.children.push_back(nodes[i]);
+            for (const LinkGraph::Edge* e = graph.begin(i); e != graph.end(i); ++e) {
+                if (coarse_index[e->node] != MULTIGRID_NO_NODE) {
+                    level.parents.push_back(coarse_index[e->node]);
+                    level.parent_links.push_back(e->link);
+                }
+            }
+            level.parent_offsets.push_back(to<uint32_t>(level.parents.size()));
+        }
+        // Links between the kept nodes two straight links apart, between
+        // indices into level.nodes, the shortest path wins
+        std::vector<LinkGraph::Link> coarse_links;
+        std::vector<std::array<uint32_t, 2>> sources;
+        for (uint64_t i(0); i < count; ++i) {
+            const uint32_t a = coarse_index[i];
+            if (a == MULTIGRID_NO_NODE) { continue; }
+            const uint64_t first_link = coarse_links.size();
+            for (const LinkGraph::Edge* e = graph.begin(i); e != graph.end(i); ++e) {
+                for (const LinkGraph::Edge* f = graph.begin(e->node); f != graph.end(e->node); ++f) {
+                    const uint32_t b = coarse_index[f->node];
+                    if (b == MULTIGRID_NO_NODE || b <= a) { continue; }
+                    if (e->direction.dot(f->direction) < MULTIGRID_STRAIGHTNESS) { continue; }
+                    const float length = e->length + f->length;
+                    bool known = false;
+                    for (uint64_t k(first_link); k < coarse_links.size(); ++k) {
+                        if (coarse_links[k].b == b) {
+                            if (length < coarse_links[k].length) {
+                                coarse_links[k].length = length;
+                                sources[k] = {e->link, f->link};
+                            }
+                            known = true;
+                        }
+                    }
+                    if (!known) {
+                        const Vec2 direction = (e->direction * e->length + f->direction * f->length).getNormalized();
+                        coarse_links.push_back({a, b, length, direction});
+                        sources.push_back({e->link, f->link});
+                    }
+                }
+            }
+        }
+        // Past this point the level falls apart in short chains, which only
+        // add noise
+        if (coarse_links.size() < level.nodes.size()) { break; }
+        level.links.reserve(coarse_links.size());
+        for (const LinkGraph::Link& link : coarse_links) {
+            level.links.push_back({level.nodes[link.a], level.nodes[link.b], link.length, link.direction});
+        }
+        level.link_sources = std::move(sources);
+        level.alive.assign(coarse_links.size(), true);
+        level.displacements.resize(level.nodes.size());
+        nodes = level.nodes;
+        links = std::move(coarse_links);
+        hierarchy.push_back(std::move(level));
+    }
+    particles_version = solver.particles_version;
+    topology_version = solver.topology_version;
+    built_levels = levels;
+    ++builds_count;
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -0,0 +1,73 @@
+/* Source file implementing include/engine/physics/physics.hpp */
+
+#include "engine/physics/physics.hpp"
+
+void PhysicSolver::update(float dt)
+{
+    PROFILE_SCOPE("physics");
+    kernel->update(*this, dt);
+}
+
+void PhysicSolver::updateKernel()
+{
+    kernel_config.friction = friction_coef != 0.0f;
+    kernel_config.threaded = thread_pool != nullptr;
+    kernel = makeSolverKernel(kernel_config);
+}
+
+void PhysicSolver::eraseBrokenLinks()
+{
+    // Breakage is applied once per sub-step
+    for (const civ::CompactID id : broken_links) {
+        constraints.erase(id);
+    }
+    bool erased = !broken_links.empty();
+    broken_links.clear();
+    erased |= shear_links.eraseBrokenLinks();
+    erased |= bend_links.eraseBrokenLinks();
+    topology_version += erased;
+}
+
+void PhysicSolver::pin(civ::CompactID particle_id)
+{
+    if (isPinned(particle_id)) { return; }
+    // Swap with the first moving particle and grow the pinned range over it
+    objects.swapData(objects.getDataID(particle_id), pinned_count++);
+    Particle& p = objects[particle_id];
+    p.inverse_mass = 0.0f;
+    p.position_old = p.position;
+    p.velocity = {};
+    p.forces = {};
+    ++topology_version;
+    ++particles_version;
+}
+
+void PhysicSolver::unpin(civ::CompactID particle_id)
+{
+    if (!isPinned(particle_id)) { return; }
+    // Swap with the last pinned particle and shrink the pinned range
+    objects.swapData(objects.getDataID(particle_id), --pinned_count);
+    Particle& p = objects[particle_id];
+    p.inverse_mass = 1.0f / p.mass;
+    p.position_old = p.position;
+    ++topology_version;
+    ++particles_version;
+}
+
+void PhysicSolver::eraseParticle(civ::CompactID particle_id)
+{
+    // Erasing swaps the last particle in place, which must not be a pinned slot
+    unpin(particle_id);
+    for (const civ::CompactHandle& link : getIncidentLinks(particle_id)) {
+        if (constraints.isValid(link)) {
+            constraints.erase(link.rid);
+        }
+    }
+    shear_links.eraseIncidentLinks(objects.data.size(), particle_id);
+    bend_links.eraseIncidentLinks(objects.data.size(), particle_id);
+    objects.erase(particle_id);
+    ++topology_version;
+    ++particles_version;
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -0,0 +1,178 @@
+/* Source file implementing include/engine/physics/projective_dynamics.hpp */
+
+#include <stdexcept>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+
+#include "engine/physics/physics.hpp"
+#include "engine/physics/projective_dynamics.hpp"
+
+struct ProjectiveDynamics::System
+{
+    using Matrix = Eigen::SparseMatrix<double>;
+    using Vectors = Eigen::Matrix<double, Eigen::Dynamic, 2>;
+
+    // AMD keeps the fill-in of the factor low on grid-like graphs
+    Eigen::SimplicialLDLT<Matrix, Eigen::Lower, Eigen::AMDOrdering<int>> ldlt;
+    // One column per coordinate, both are solved with the same factor
+    Vectors rhs;
+    Vectors positions;
+};
+
+ProjectiveDynamics::ProjectiveDynamics()
+    : factorizations_count(0)
+    , topology_version(0)
+    , factorized_dt(0.0f)
+    , system(std::make_unique<System>())
+{}
+
+ProjectiveDynamics::~ProjectiveDynamics() = default;
+
+bool ProjectiveDynamics::needsFactorization(const PhysicSolver& solver, float dt) const
+{
+    return factorized_dt != dt || topology_version != solver.topology_version;
+}
+
+void ProjectiveDynamics::factorize(PhysicSolver& solver, float dt)
+{
+    PROFILE_SCOPE("pd factorize");
+    const uint64_t first = solver.pinned_count;
+    const uint64_t count = solver.objects.size() - first;
+    const uint64_t links_count = solver.constraints.size();
+    const double inv_dt2 = 1.0 / (static_cast<double>(dt) * dt);
+
+    std::vector<Eigen::Triplet<double>> triplets;
+    triplets.reserve(count + 4 * links_count);
+    for (uint64_t i(0); i < count; ++i) {
+        const int j = to<int>(i);
+        triplets.emplace_back(j, j, solver.objects.data[first + i].mass * inv_dt2);
+    }
+    weights.resize(links_count);
+    weighted_projections.resize(links_count);
+    incidence_offsets.assign(count + 1, 0);
+    for (uint64_t k(0); k < links_count; ++k) {
+        const LinkConstraint& link = solver.constraints.data[k];
+        const float compliance = solver.constraints.cold[k].compliance;
+        const float w = compliance > 0.0f ? 1.0f / compliance : PD_INEXTENSIBLE_STIFFNESS;
+        weights[k] = w;
+        const uint64_t a = solver.objects.getDataID(link.particle_1.getID());
+        const uint64_t b = solver.objects.getDataID(link.particle_2.getID());
+        if (a >= first) {
+            triplets.emplace_back(to<int>(a - first), to<int>(a - first), w);
+            ++incidence_offsets[a - first + 1];
+        }
+        if (b >= first) {
+            triplets.emplace_back(to<int>(b - first), to<int>(b - first), w);
+            ++incidence_offsets[b - first + 1];
+        }
+        if (a >= first && b >= first) {
+            triplets.emplace_back(to<int>(a - first), to<int>(b - first), -w);
+            triplets.emplace_back(to<int>(b - first), to<int>(a - first), -w);
+        }
+    }
+    for (uint64_t i(1); i < incidence_offsets.size(); ++i) {
+        incidence_offsets[i] += incidence_offsets[i - 1];
+    }
+    // Fill, using a copy of the offsets as insertion cursors
+    std::vector<uint32_t> cursors(incidence_offsets.begin(), incidence_offsets.end() - 1);
+    incidences.resize(incidence_offsets.back());
+    for (uint64_t k(0); k < links_count; ++k) {
+        const LinkConstraint& link = solver.constraints.data[k];
+        const uint64_t a = solver.objects.getDataID(link.particle_1.getID());
+        const uint64_t b = solver.objects.getDataID(link.particle_2.getID());
+        const uint32_t link_index = to<uint32_t>(k);
+        if (a >= first) {
+            incidences[cursors[a - first]++] = {link_index, b >= first ? NO_PARTICLE : to<uint32_t>(b), 1.0f};
+        }
+        if (b >= first) {
+            incidences[cursors[b - first]++] = {link_index, a >= first ? NO_PARTICLE : to<uint32_t>(a), -1.0f};
+        }
+    }
+
+    System::Matrix matrix(to<int>(count), to<int>(count));
+    matrix.setFromTriplets(triplets.begin(), triplets.end());
+    system->ldlt.compute(matrix);
+    if (system->ldlt.info() != Eigen::Success) {
+        throw std::runtime_error("projective dynamics: the system factorization failed");
+    }
+    system->rhs.resize(to<int>(count), 2);
+    predictions.resize(count);
+
+    topology_version = solver.topology_version;
+    factorized_dt = dt;
+    ++factorizations_count;
+}
+
+void ProjectiveDynamics::solve(PhysicSolver& solver, float dt)
+{
+    if (needsFactorization(solver, dt)) {
+        factorize(solver, dt);
+    }
+    const uint64_t count = predictions.size();
+    if (!count) { return; }
+    const Particle* const moving = solver.objects.data.data() + solver.pinned_count;
+    solver.parallelFor(count, [&](uint64_t start, uint64_t end) {
+        for (uint64_t i(start); i < end; ++i) {
+            predictions[i] = moving[i].position;
+        }
+    });
+    for (uint32_t i(0); i < solver.solver_iterations; ++i) {
+        project(solver);
+        solveGlobal(solver, dt);
+    }
+}
+
+void ProjectiveDynamics::project(PhysicSolver& solver)
+{
+    PROFILE_SCOPE("pd local");
+    LinkConstraint* const links = solver.constraints.data.data();
+    solver.parallelFor(solver.constraints.size(), [&](uint64_t start, uint64_t end) {
+        for (uint64_t k(start); k < end; ++k) {
+            LinkConstraint& link = links[k];
+            const Vec2 v = link.particle_1->position - link.particle_2->position;
+            const float length = v.getLength();
+            // Slack links keep their current length and pull nothing
+            const Vec2 p = length > link.distance ? v * (link.distance / length) : v;
+            weighted_projections[k] = p * weights[k];
+        }
+    });
+}
+
+void ProjectiveDynamics::solveGlobal(PhysicSolver& solver, float dt)
+{
+    PROFILE_SCOPE("pd global");
+    const uint64_t count = predictions.size();
+    Particle* const particles = solver.objects.data.data();
+    Particle* const moving = particles + solver.pinned_count;
+    const double inv_dt2 = 1.0 / (static_cast<double>(dt) * dt);
+    System::Vectors& rhs = system->rhs;
+    solver.parallelFor(count, [&](uint64_t start, uint64_t end) {
+        for (uint64_t i(start); i < end; ++i) {
+            const double inertia = moving[i].mass * inv_dt2;
+            double x = inertia * predictions[i].x;
+            double y = inertia * predictions[i].y;
+            for (uint32_t e(incidence_offsets[i]); e < incidence_offsets[i + 1]; ++e) {
+                const Incidence& incidence = incidences[e];
+                const Vec2 p = weighted_projections[incidence.link];
+                x += incidence.sign * p.x;
+                y += incidence.sign * p.y;
+                if (incidence.pinned != NO_PARTICLE) {
+                    const double w = weights[incidence.link];
+                    x += w * particles[incidence.pinned].position.x;
+                    y += w * particles[incidence.pinned].position.y;
+                }
+            }
+            rhs(to<int>(i), 0) = x;
+            rhs(to<int>(i), 1) = y;
+        }
+    });
+    system->positions = system->ldlt.solve(rhs);
+    const System::Vectors& positions = system->positions;
+    solver.parallelFor(count, [&](uint64_t start, uint64_t end) {
+        for (uint64_t i(start); i < end; ++i) {
+            moving[i].position = Vec2(to<float>(positions(to<int>(i), 0)), to<float>(positions(to<int>(i), 1)));
+        }
+    });
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */
@@ -0,0 +1,127 @@
+/* Source file implementing include/engine/physics/solver_kernel.hpp
+ *
+ * Every combination of policies is instantiated here, the factory picks one
+ * at runtime. The projective dynamics kernels need a build with Eigen3, which
+ * defines CLOTH_PROJECTIVE_DYNAMICS.
+ */
+
+#include <stdexcept>
+#include <type_traits>
+#include "engine/physics/solver_policies.hpp"
+
+const char* getIntegratorName(Integrator integrator)
+{
+    switch (integrator) {
+        case Integrator::SemiImplicitEuler:
+            return SemiImplicitEuler::NAME;
+        case Integrator::Verlet:
+            return Verlet::NAME;
+    }
+    return "unknown";
+}
+
+bool parseIntegrator(const std::string& name, Integrator& integrator)
+{
+    if (name == SemiImplicitEuler::NAME) {
+        integrator = Integrator::SemiImplicitEuler;
+    } else if (name == Verlet::NAME) {
+        integrator = Integrator::Verlet;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* getConstraintSolverName(ConstraintSolver constraint_solver)
+{
+    switch (constraint_solver) {
+        case ConstraintSolver::PBD:
+            return DistanceConstraint::NAME;
+        case ConstraintSolver::XPBD:
+            return XPBDConstraint::NAME;
+        case ConstraintSolver::ProjectiveDynamics:
+            return ProjectiveDynamicsConstraint::NAME;
+    }
+    return "unknown";
+}
+
+bool parseConstraintSolver(const std::string& name, ConstraintSolver& constraint_solver)
+{
+    if (name == DistanceConstraint::NAME) {
+        constraint_solver = ConstraintSolver::PBD;
+    } else if (name == XPBDConstraint::NAME) {
+        constraint_solver = ConstraintSolver::XPBD;
+#ifdef CLOTH_PROJECTIVE_DYNAMICS
+    } else if (name == ProjectiveDynamicsConstraint::NAME) {
+        constraint_solver = ConstraintSolver::ProjectiveDynamics;
+#endif
+    } else {
+        return false;
+    }
+    return true;
+}
+
+template<typename TIntegrator, typename TFriction, typename TConstraint, typename TWind, typename TExecution>
+using KernelType = std::conditional_t<std::is_same_v<TConstraint, ProjectiveDynamicsConstraint>,
+                                      ProjectiveDynamicsKernel<TIntegrator, TFriction, TWind, TExecution>,
+                                      SpecializedKernel<TIntegrator, TFriction, TConstraint, TWind, TExecution>>;
+
+// Each level resolves one runtime setting into a policy type
+
+template<typename TIntegrator, typename TFriction, typename TConstraint, typename TWind>
+static std::unique_ptr<SolverKernel> makeKernel(const SolverKernelConfig& config)
+{
+    if (config.threaded) {
+        return std::make_unique<KernelType<TIntegrator, TFriction, TConstraint, TWind, PoolExecution>>();
+    }
+    return std::make_unique<KernelType<TIntegrator, TFriction, TConstraint, TWind, SerialExecution>>();
+}
+
+template<typename TIntegrator, typename TFriction, typename TConstraint>
+static std::unique_ptr<SolverKernel> makeKernel(const SolverKernelConfig& config)
+{
+    if (config.wind) {
+        return makeKernel<TIntegrator, TFriction, TConstraint, RectWind>(config);
+    }
+    return makeKernel<TIntegrator, TFriction, TConstraint, NoWind>(config);
+}
+
+template<typename TIntegrator, typename TFriction>
+static std::unique_ptr<SolverKernel> makeKernel(const SolverKernelConfig& config)
+{
+    switch (config.constraint_solver) {
+        case ConstraintSolver::XPBD:
+            return makeKernel<TIntegrator, TFriction, XPBDConstraint>(config);
+        case ConstraintSolver::ProjectiveDynamics:
+#ifdef CLOTH_PROJECTIVE_DYNAMICS
+            return makeKernel<TIntegrator, TFriction, ProjectiveDynamicsConstraint>(config);
+#else
+            throw std::logic_error("the projective dynamics solver needs a build with Eigen3");
+#endif
+        case ConstraintSolver::PBD:
+            break;
+    }
+    return makeKernel<TIntegrator, TFriction, DistanceConstraint>(config);
+}
+
+template<typename TIntegrator>
+static std::unique_ptr<SolverKernel> makeKernel(const SolverKernelConfig& config)
+{
+    if (config.friction) {
+        return makeKernel<TIntegrator, AirFriction>(config);
+    }
+    return makeKernel<TIntegrator, NoFriction>(config);
+}
+
+std::unique_ptr<SolverKernel> makeSolverKernel(const SolverKernelConfig& config)
+{
+    switch (config.integrator) {
+        case Integrator::Verlet:
+            return makeKernel<Verlet>(config);
+        case Integrator::SemiImplicitEuler:
+            break;
+    }
+    return makeKernel<SemiImplicitEuler>(config);
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */
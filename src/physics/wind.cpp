@@ -0,0 +1,18 @@
+/* Source file implementing include/engine/physics/wind.hpp */
+
+#include "engine/physics/wind.hpp"
+
+void WindManager::update(PhysicSolver& solver, float dt)
+{
+    for (Wind& w : winds) {
+        w.update(dt);
+    }
+    solver.kernel->applyWind(solver, winds, dt);
+    for (Wind& w : winds) {
+        if (w.rect.left > world_width) {
+            w.rect.left = -w.rect.width;
+        }
+    }
+}
+
+/* vim: set ts=4 sts=4 sw=4 et: */